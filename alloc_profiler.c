@@ -0,0 +1,272 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "alloc_profiler.h"
+#include "tooling.h"
+#include "vm.h"
+
+// Number of sites listed in the report.
+#define ALLOC_REPORT_TOP 30
+
+AllocProfiler* alloc_profiler = NULL;
+
+static void* allocate_table(size_t count, size_t size) {
+  void* table = calloc(count, size);
+
+  if (table == NULL) {
+    fprintf(stderr, "Not enough memory for the allocation profiler.\n");
+    exit(74);
+  }
+
+  return table;
+}
+
+static size_t hash_site(ObjectFunction* function, size_t line, ObjectType type) {
+  return hash_pointer(function) ^ (line * 31 + type) * 0x9e3779b9u;
+}
+
+static AllocSite* find_site(AllocSite* sites, size_t capacity,
+                            ObjectFunction* function, size_t line, ObjectType type) {
+  size_t index = hash_site(function, line, type) & (capacity - 1);
+
+  for (;;) {
+    AllocSite* site = &sites[index];
+
+    // a used site always has a count
+    if (site->count == 0) return site;
+    if (site->function == function && site->line == line && site->type == type) return site;
+
+    index = (index + 1) & (capacity - 1);
+  }
+}
+
+static size_t site_index(AllocProfiler* profiler, ObjectFunction* function,
+                         size_t line, ObjectType type) {
+  if (profiler->site_count + 1 > profiler->site_capacity * 3 / 4) {
+    size_t capacity = profiler->site_capacity < 64 ? 64 : profiler->site_capacity * 2;
+    AllocSite* sites = allocate_table(capacity, sizeof(AllocSite));
+
+    for (size_t i = 0; i < profiler->site_capacity; i++) {
+      AllocSite* site = &profiler->sites[i];
+      if (site->count == 0) continue;
+      *find_site(sites, capacity, site->function, site->line, site->type) = *site;
+    }
+
+    // live objects refer to sites by index, remap them
+    for (size_t i = 0; i < profiler->live_capacity; i++) {
+      AllocRecord* record = &profiler->live[i];
+      if (record->object == NULL) continue;
+
+      AllocSite* site = &profiler->sites[record->site];
+      record->site = find_site(sites, capacity, site->function, site->line, site->type) - sites;
+    }
+
+    free(profiler->sites);
+    profiler->sites = sites;
+    profiler->site_capacity = capacity;
+  }
+
+  AllocSite* site = find_site(profiler->sites, profiler->site_capacity, function, line, type);
+
+  if (site->count == 0) {
+    site->function = function;
+    site->line = line;
+    site->type = type;
+    profiler->site_count++;
+  }
+
+  return (size_t) (site - profiler->sites);
+}
+
+static AllocRecord* find_record(AllocRecord* live, size_t capacity, Object* object) {
+  size_t index = hash_pointer(object) & (capacity - 1);
+
+  while (live[index].object != NULL && live[index].object != object) {
+    index = (index + 1) & (capacity - 1);
+  }
+
+  return &live[index];
+}
+
+static void add_record(AllocProfiler* profiler, Object* object, size_t site, size_t bytes) {
+  if (profiler->live_count + 1 > profiler->live_capacity * 3 / 4) {
+    size_t capacity = profiler->live_capacity < 1024 ? 1024 : profiler->live_capacity * 2;
+    AllocRecord* live = allocate_table(capacity, sizeof(AllocRecord));
+
+    for (size_t i = 0; i < profiler->live_capacity; i++) {
+      if (profiler->live[i].object == NULL) continue;
+      *find_record(live, capacity, profiler->live[i].object) = profiler->live[i];
+    }
+
+    free(profiler->live);
+    profiler->live = live;
+    profiler->live_capacity = capacity;
+  }
+
+  AllocRecord* record = find_record(profiler->live, profiler->live_capacity, object);
+
+  // the address of an object freed behind the profiler's back was reused
+  if (record->object == NULL) profiler->live_count++;
+
+  *record = (AllocRecord) { object, site, bytes };
+}
+
+/**
+ * Removes a record, shifting back the records after it which probed past
+ * its slot so lookups never stop early.
+ */
+static void remove_record(AllocProfiler* profiler, AllocRecord* record) {
+  size_t mask = profiler->live_capacity - 1;
+  size_t hole = (size_t) (record - profiler->live);
+  size_t index = hole;
+
+  for (;;) {
+    index = (index + 1) & mask;
+    AllocRecord* next = &profiler->live[index];
+    if (next->object == NULL) break;
+
+    size_t home = hash_pointer(next->object) & mask;
+
+    // move it unless its home lies cyclically in (hole, index]
+    bool stays = hole <= index ? (hole < home && home <= index)
+                               : (hole < home || home <= index);
+    if (stays) continue;
+
+    profiler->live[hole] = *next;
+    hole = index;
+  }
+
+  profiler->live[hole].object = NULL;
+  profiler->live_count--;
+}
+
+void AllocProfiler_start(AllocProfiler* profiler, VM* vm) {
+  profiler->vm = vm;
+  profiler->sites = NULL;
+  profiler->site_count = 0;
+  profiler->site_capacity = 0;
+  profiler->live = NULL;
+  profiler->live_count = 0;
+  profiler->live_capacity = 0;
+
+  alloc_profiler = profiler;
+}
+
+void AllocProfiler_stop(AllocProfiler* profiler) {
+  if (alloc_profiler == profiler) alloc_profiler = NULL;
+}
+
+void AllocProfiler_record(AllocProfiler* profiler, Object* object, size_t bytes) {
+  VM* vm = profiler->vm;
+  ObjectFunction* function = NULL;
+  size_t line = 0;
+
+  if (vm->frame_count > 0) {
+    CallFrame* frame = &vm->frames[vm->frame_count - 1];
+    function = frame->closure->function;
+
+    Chunk* chunk = &function->chunk;
+
+    // ip is already past the opcode being executed
+    if (frame->ip > chunk->code && frame->ip <= chunk->code + chunk->count) {
+      line = Chunk_get_line(chunk, frame->ip - chunk->code - 1);
+    }
+  }
+
+  size_t index = site_index(profiler, function, line, object->type);
+  AllocSite* site = &profiler->sites[index];
+  site->count++;
+  site->bytes += bytes;
+
+  add_record(profiler, object, index, bytes);
+}
+
+void AllocProfiler_add_bytes(AllocProfiler* profiler, Object* object, size_t bytes) {
+  if (profiler->live_capacity == 0) return;
+
+  AllocRecord* record = find_record(profiler->live, profiler->live_capacity, object);
+  if (record->object == NULL) return;
+
+  record->bytes += bytes;
+  profiler->sites[record->site].bytes += bytes;
+}
+
+void AllocProfiler_release(AllocProfiler* profiler, Object* object) {
+  if (profiler->live_capacity == 0) return;
+
+  AllocRecord* record = find_record(profiler->live, profiler->live_capacity, object);
+
+  // allocated before the profiler was installed
+  if (record->object == NULL) return;
+
+  AllocSite* site = &profiler->sites[record->site];
+  site->freed_count++;
+  site->freed_bytes += record->bytes;
+
+  remove_record(profiler, record);
+}
+
+static int compare_sites(const void* a, const void* b) {
+  uint64_t x = (*(AllocSite* const*) a)->bytes;
+  uint64_t y = (*(AllocSite* const*) b)->bytes;
+  return (x < y) - (x > y);
+}
+
+void AllocProfiler_print(AllocProfiler* profiler, FILE* file) {
+  AllocSite** sorted = allocate_table(profiler->site_count + 1, sizeof(AllocSite*));
+  size_t count = 0;
+  uint64_t total_bytes = 0;
+  uint64_t total_count = 0;
+
+  for (size_t i = 0; i < profiler->site_capacity; i++) {
+    AllocSite* site = &profiler->sites[i];
+    if (site->count == 0) continue;
+
+    sorted[count++] = site;
+    total_bytes += site->bytes;
+    total_count += site->count;
+  }
+
+  qsort(sorted, count, sizeof(AllocSite*), compare_sites);
+
+  fprintf(file, "-- %llu objects, %llu bytes allocated, %zu alive\n",
+          (unsigned long long) total_count, (unsigned long long) total_bytes,
+          profiler->live_count);
+  fprintf(file, "%-32s %-12s %12s %14s %7s %12s %14s\n",
+          "site", "type", "objects", "bytes", "bytes %", "alive", "alive bytes");
+
+  for (size_t i = 0; i < count && i < ALLOC_REPORT_TOP; i++) {
+    AllocSite* site = sorted[i];
+    char name[64];
+
+    if (site->function == NULL) {
+      snprintf(name, sizeof(name), "compiler");
+    } else {
+      snprintf(name, sizeof(name), "%s:%zu",
+               site->function->name != NULL ? site->function->name->chars : "script",
+               site->line);
+    }
+
+    fprintf(file, "%-32s %-12s %12llu %14llu %6.2f%% %12llu %14llu\n",
+            name, ObjectType_name(site->type),
+            (unsigned long long) site->count, (unsigned long long) site->bytes,
+            total_bytes > 0 ? 100.0 * site->bytes / total_bytes : 0.0,
+            (unsigned long long) (site->count - site->freed_count),
+            (unsigned long long) (site->bytes - site->freed_bytes));
+  }
+
+  free(sorted);
+}
+
+void AllocProfiler_free(AllocProfiler* profiler) {
+  AllocProfiler_stop(profiler);
+  free(profiler->sites);
+  free(profiler->live);
+  profiler->sites = NULL;
+  profiler->site_count = 0;
+  profiler->site_capacity = 0;
+  profiler->live = NULL;
+  profiler->live_count = 0;
+  profiler->live_capacity = 0;
+}
@@ -0,0 +1,87 @@
+#ifndef peach_alloc_profiler_h
+#define peach_alloc_profiler_h
+
+#include <stdio.h>
+
+#include "common.h"
+#include "object.h"
+
+struct VM;
+
+/**
+ * Allocations of one object type at one source line. Objects allocated
+ * while no frame runs, by the compiler, have no function.
+ */
+typedef struct {
+  ObjectFunction* function;
+  size_t line;
+  ObjectType type;
+
+  uint64_t count;
+  uint64_t bytes;
+
+  // Objects of the site released by free_object().
+  uint64_t freed_count;
+  uint64_t freed_bytes;
+} AllocSite;
+
+/**
+ * A live object, mapped to the site which allocated it.
+ */
+typedef struct {
+  Object* object;
+  size_t site;
+  size_t bytes;
+} AllocRecord;
+
+/**
+ * An allocation-site profiler. Every object created while it is installed
+ * is attributed to the function and line the innermost frame is running,
+ * and followed until it is freed, so the report tells apart the sites
+ * which churn from those whose objects survive.
+ */
+typedef struct {
+  struct VM* vm;
+
+  // Open addressing table of the sites, keyed by function, line and type.
+  AllocSite* sites;
+  size_t site_count;
+  size_t site_capacity;
+
+  // Open addressing table of the live objects, keyed by their address.
+  AllocRecord* live;
+  size_t live_count;
+  size_t live_capacity;
+} AllocProfiler;
+
+/**
+ * The installed profiler, NULL unless profiling allocations.
+ */
+extern AllocProfiler* alloc_profiler;
+
+/**
+ * Installs `profiler` for the allocations of `vm`.
+ */
+void AllocProfiler_start(AllocProfiler* profiler, struct VM* vm);
+
+void AllocProfiler_stop(AllocProfiler* profiler);
+
+void AllocProfiler_record(AllocProfiler* profiler, Object* object, size_t bytes);
+
+/**
+ * Adds memory an object owns outside its struct, such as the characters
+ * of a string, to the object and its site.
+ */
+void AllocProfiler_add_bytes(AllocProfiler* profiler, Object* object, size_t bytes);
+
+void AllocProfiler_release(AllocProfiler* profiler, Object* object);
+
+/**
+ * Writes the sites allocating the most bytes, with their counts and how
+ * many of their objects are still alive.
+ */
+void AllocProfiler_print(AllocProfiler* profiler, FILE* file);
+
+void AllocProfiler_free(AllocProfiler* profiler);
+
+#endif // !peach_alloc_profiler_h
@@ -0,0 +1,284 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+#define DEFAULT_RUNS 5
+#define MAX_RUNS 100
+
+/**
+ * Measurements of one execution of a benchmark script. `instructions` is
+ * -1 when hardware counters aren't available.
+ */
+typedef struct {
+  double seconds;
+  int64_t instructions;
+  long peak_rss_kb;
+  bool failed;
+} Sample;
+
+typedef struct {
+  double median_ms;
+  double min_ms;
+  double max_ms;
+  int64_t instructions;
+  long peak_rss_kb;
+  bool failed;
+} Summary;
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Opens a counter of the user-space instructions retired by `pid`, which
+ * starts counting when the process calls exec. Returns -1 if the kernel
+ * doesn't allow it, which is common in containers.
+ */
+static int open_instruction_counter(pid_t pid) {
+#ifdef __linux__
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+  attr.disabled = 1;
+  attr.enable_on_exec = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.inherit = 1;
+
+  return (int) syscall(SYS_perf_event_open, &attr, pid, -1, -1, 0);
+#else
+  (void) pid;
+  return -1;
+#endif
+}
+
+/**
+ * Runs `binary script` once with its output discarded. The child waits on
+ * a pipe until the instruction counter is attached, so only the benchmark
+ * itself is counted.
+ */
+static Sample run_once(const char* binary, const char* script) {
+  Sample sample = { .seconds = 0, .instructions = -1, .peak_rss_kb = 0, .failed = true };
+
+  int gate[2];
+  if (pipe(gate) != 0) {
+    perror("pipe");
+    return sample;
+  }
+
+  pid_t pid = fork();
+
+  if (pid < 0) {
+    perror("fork");
+    close(gate[0]);
+    close(gate[1]);
+    return sample;
+  }
+
+  if (pid == 0) {
+    close(gate[1]);
+
+    char go;
+    if (read(gate[0], &go, 1) != 1) _exit(127);
+    close(gate[0]);
+
+    int null = open("/dev/null", O_WRONLY);
+    if (null >= 0) dup2(null, STDOUT_FILENO);
+
+    execl(binary, binary, script, (char*) NULL);
+    _exit(127);
+  }
+
+  close(gate[0]);
+  int counter = open_instruction_counter(pid);
+
+  double start = now();
+  if (write(gate[1], "g", 1) != 1) perror("write");
+  close(gate[1]);
+
+  int status;
+  struct rusage usage;
+  while (wait4(pid, &status, 0, &usage) < 0) {
+    if (errno != EINTR) {
+      perror("wait4");
+      if (counter >= 0) close(counter);
+      return sample;
+    }
+  }
+
+  sample.seconds = now() - start;
+  sample.peak_rss_kb = usage.ru_maxrss;
+  sample.failed = !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+
+  if (counter >= 0) {
+    uint64_t count;
+    if (read(counter, &count, sizeof(count)) == sizeof(count)) {
+      sample.instructions = (int64_t) count;
+    }
+    close(counter);
+  }
+
+  return sample;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+  double x = *(const double*) a;
+  double y = *(const double*) b;
+  return (x > y) - (x < y);
+}
+
+static int compare_int64s(const void* a, const void* b) {
+  int64_t x = *(const int64_t*) a;
+  int64_t y = *(const int64_t*) b;
+  return (x > y) - (x < y);
+}
+
+static Summary measure(const char* binary, const char* script, int runs) {
+  double times[MAX_RUNS];
+  int64_t instructions[MAX_RUNS];
+  Summary summary = { .instructions = -1, .peak_rss_kb = 0, .failed = false };
+
+  for (int i = 0; i < runs; i++) {
+    Sample sample = run_once(binary, script);
+
+    if (sample.failed) {
+      summary.failed = true;
+      return summary;
+    }
+
+    times[i] = sample.seconds * 1000;
+    instructions[i] = sample.instructions;
+    if (sample.peak_rss_kb > summary.peak_rss_kb) summary.peak_rss_kb = sample.peak_rss_kb;
+  }
+
+  qsort(times, runs, sizeof(double), compare_doubles);
+  qsort(instructions, runs, sizeof(int64_t), compare_int64s);
+
+  summary.min_ms = times[0];
+  summary.max_ms = times[runs - 1];
+  summary.median_ms = runs % 2 ? times[runs / 2] : (times[runs / 2 - 1] + times[runs / 2]) / 2;
+
+  // a run without a counter makes the whole count unknown
+  summary.instructions = instructions[0] < 0 ? -1 : instructions[runs / 2];
+
+  return summary;
+}
+
+static void print_json_string(const char* str) {
+  putchar('"');
+  for (const char* c = str; *c != '\0'; c++) {
+    if (*c == '"' || *c == '\\') putchar('\\');
+    putchar(*c);
+  }
+  putchar('"');
+}
+
+static void print_summary(const char* binary, Summary* summary) {
+  printf("{\"binary\": ");
+  print_json_string(binary);
+
+  if (summary->failed) {
+    printf(", \"failed\": true}");
+    return;
+  }
+
+  printf(", \"median_ms\": %.3f, \"min_ms\": %.3f, \"max_ms\": %.3f",
+         summary->median_ms, summary->min_ms, summary->max_ms);
+
+  if (summary->instructions < 0) {
+    printf(", \"instructions\": null");
+  } else {
+    printf(", \"instructions\": %lld", (long long) summary->instructions);
+  }
+
+  printf(", \"peak_rss_kb\": %ld}", summary->peak_rss_kb);
+}
+
+static const char* script_name(const char* path) {
+  const char* slash = strrchr(path, '/');
+  return slash != NULL ? slash + 1 : path;
+}
+
+static void usage() {
+  fprintf(stderr, "Usage: bench_runner [--runs N] [--baseline peach] peach script...\n");
+  exit(64);
+}
+
+/**
+ * Runs every script with `peach` several times and prints the timings as
+ * JSON. Given a baseline build, each script is measured with both and the
+ * speedup of the median time is reported.
+ */
+int main(int argc, char* argv[]) {
+  int runs = DEFAULT_RUNS;
+  const char* baseline = NULL;
+  int arg = 1;
+
+  for (; arg < argc && strncmp(argv[arg], "--", 2) == 0; arg++) {
+    if (strcmp(argv[arg], "--runs") == 0 && arg + 1 < argc) {
+      runs = atoi(argv[++arg]);
+      if (runs < 1 || runs > MAX_RUNS) usage();
+    } else if (strcmp(argv[arg], "--baseline") == 0 && arg + 1 < argc) {
+      baseline = argv[++arg];
+    } else {
+      usage();
+    }
+  }
+
+  if (argc - arg < 2) usage();
+
+  const char* binary = argv[arg++];
+  bool failed = false;
+
+  printf("{\"runs\": %d, \"benchmarks\": [", runs);
+
+  for (int i = arg; i < argc; i++) {
+    const char* script = argv[i];
+    Summary summary = measure(binary, script, runs);
+    failed |= summary.failed;
+
+    printf(i > arg ? ",\n  " : "\n  ");
+    printf("{\"name\": ");
+    print_json_string(script_name(script));
+    printf(", \"result\": ");
+    print_summary(binary, &summary);
+
+    if (baseline != NULL) {
+      Summary base = measure(baseline, script, runs);
+      failed |= base.failed;
+
+      printf(", \"baseline\": ");
+      print_summary(baseline, &base);
+
+      if (!summary.failed && !base.failed) {
+        printf(", \"speedup\": %.3f", base.median_ms / summary.median_ms);
+      }
+    }
+
+    printf("}");
+    fflush(stdout);
+  }
+
+  printf("\n]}\n");
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../peach.h"
+
+#define CALLS 1000000
+#define INTERPRETED_CALLS 20000
+#define ITERATIONS 5
+
+// A small request handler, as a host would call per request.
+static const char* script =
+  "fn handle(id, weight) {\n"
+  "  let score = id * 31 + weight;\n"
+  "  if score % 2 == 0 {\n"
+  "    return score / 2;\n"
+  "  }\n"
+  "  return score;\n"
+  "}\n";
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void check(PeachResult result) {
+  if (result != PEACH_OK) {
+    fprintf(stderr, "handler failed.\n");
+    exit(70);
+  }
+}
+
+/**
+ * Invokes the resolved handler, returning the best time per call in ns.
+ */
+static double bench_invoke(PeachVM* vm, PeachFunction* handle, int64_t* checksum) {
+  double best = 0;
+
+  for (int i = 0; i < ITERATIONS; i++) {
+    double start = now();
+
+    for (int64_t call = 0; call < CALLS; call++) {
+      PeachValue args[2] = { peach_int(call), peach_int(7) };
+      PeachValue result;
+      check(peach_invoke(vm, handle, 2, args, &result));
+      *checksum += result.as.integer;
+    }
+
+    double ns = (now() - start) * 1e9 / CALLS;
+    if (best == 0 || ns < best) best = ns;
+  }
+
+  return best;
+}
+
+/**
+ * Calls the handler by name, looking it up on every call.
+ */
+static double bench_call(PeachVM* vm, int64_t* checksum) {
+  double best = 0;
+
+  for (int i = 0; i < ITERATIONS; i++) {
+    double start = now();
+
+    for (int64_t call = 0; call < CALLS; call++) {
+      PeachValue args[2] = { peach_int(call), peach_int(7) };
+      PeachValue result;
+      check(peach_call(vm, "handle", 2, args, &result));
+      *checksum += result.as.integer;
+    }
+
+    double ns = (now() - start) * 1e9 / CALLS;
+    if (best == 0 || ns < best) best = ns;
+  }
+
+  return best;
+}
+
+/**
+ * Compiles and runs a source string per call, as VM_interpret() would.
+ */
+static double bench_interpret(PeachVM* vm) {
+  double best = 0;
+  char source[256];
+
+  for (int i = 0; i < ITERATIONS; i++) {
+    double start = now();
+
+    for (int call = 0; call < INTERPRETED_CALLS; call++) {
+      snprintf(source, sizeof(source), "result = handle(%d, 7);", call);
+      check(peach_interpret(vm, source));
+    }
+
+    double ns = (now() - start) * 1e9 / INTERPRETED_CALLS;
+    if (best == 0 || ns < best) best = ns;
+  }
+
+  return best;
+}
+
+int main(void) {
+  PeachVM* vm = peach_new();
+  check(peach_interpret(vm, script));
+  peach_set_global(vm, "result", peach_nil());
+
+  PeachFunction* handle = peach_function(vm, "handle");
+  if (handle == NULL) {
+    fprintf(stderr, "handler not defined.\n");
+    return 70;
+  }
+
+  int64_t invoked = 0;
+  int64_t called = 0;
+
+  double invoke = bench_invoke(vm, handle, &invoked);
+  double call = bench_call(vm, &called);
+  double interpret = bench_interpret(vm);
+
+  if (invoked != called) {
+    fprintf(stderr, "results differ: %lld and %lld.\n", (long long) invoked, (long long) called);
+    return 70;
+  }
+
+  printf("peach_invoke:    %8.1f ns/call\n", invoke);
+  printf("peach_call:      %8.1f ns/call\n", call);
+  printf("peach_interpret: %8.1f ns/call\n", interpret);
+
+  peach_free(vm);
+  return 0;
+}
@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../scanner.h"
+
+#define TARGET_SIZE (8 * 1024 * 1024)
+#define ITERATIONS 5
+
+static const char* snippet =
+  "// Compute a few fibonacci numbers and print them\n"
+  "fn fibonacci_number(n) {\n"
+  "    if n < 2 {\n"
+  "        return n;\n"
+  "    }\n"
+  "\n"
+  "    return fibonacci_number(n - 2) + fibonacci_number(n - 1);\n"
+  "}\n"
+  "\n"
+  "let counter = 0;\n"
+  "let message = \"the quick brown fox jumps over the lazy dog\";\n"
+  "while counter < 100 and !false {\n"
+  "    print fibonacci_number(counter) * 3.14159 / 2;\n"
+  "    counter = counter + 1;  // advance\n"
+  "}\n"
+  "\n";
+
+static char* generate_source(size_t* length) {
+  const size_t snippet_length = strlen(snippet);
+  const size_t count = TARGET_SIZE / snippet_length + 1;
+
+  char* source = malloc(count * snippet_length + 1);
+  if (source == NULL) {
+    fprintf(stderr, "Not enough memory to generate source.\n");
+    exit(74);
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    memcpy(source + i * snippet_length, snippet, snippet_length);
+  }
+
+  *length = count * snippet_length;
+  source[*length] = '\0';
+  return source;
+}
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(void) {
+  size_t length;
+  char* source = generate_source(&length);
+
+  double best = 0;
+  size_t tokens = 0;
+  size_t lines = 0;
+
+  for (int i = 0; i < ITERATIONS; i++) {
+    Scanner scanner;
+    Scanner_init(&scanner, source);
+    tokens = 0;
+
+    double start = now();
+
+    for (;;) {
+      Token token = Scanner_scan_token(&scanner);
+      if (token.type == TOKEN_EOF) break;
+
+      if (token.type == TOKEN_ERROR) {
+        fprintf(stderr, "[line %zu] %s\n", token.line, token.start);
+        return 65;
+      }
+
+      tokens++;
+    }
+
+    double elapsed = now() - start;
+    double throughput = length / elapsed / (1024 * 1024);
+    if (throughput > best) best = throughput;
+    lines = scanner.line;
+  }
+
+  printf("source: %.2f MB, %zu lines, %zu tokens\n",
+         length / (1024.0 * 1024.0), lines, tokens);
+  printf("lexer throughput: %.1f MB/s\n", best);
+
+  free(source);
+  return 0;
+}
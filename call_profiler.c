@@ -0,0 +1,252 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "call_profiler.h"
+#include "tooling.h"
+#include "vm.h"
+
+// Frame index recorded for the activation of a native.
+#define NATIVE_FRAME -1
+
+static void out_of_memory(void) {
+  fprintf(stderr, "Not enough memory for the call profiler.\n");
+  exit(74);
+}
+
+static void* grow(void* array, size_t size) {
+  array = realloc(array, size);
+  if (array == NULL) out_of_memory();
+  return array;
+}
+
+static CallStats* find_slot(CallStats* stats, size_t capacity, Object* callee) {
+  size_t index = hash_pointer(callee) & (capacity - 1);
+
+  while (stats[index].callee != NULL && stats[index].callee != callee) {
+    index = (index + 1) & (capacity - 1);
+  }
+
+  return &stats[index];
+}
+
+static size_t stats_index(CallProfiler* profiler, Object* callee) {
+  if (profiler->stats_count + 1 > profiler->stats_capacity * 3 / 4) {
+    size_t capacity = profiler->stats_capacity < 64 ? 64 : profiler->stats_capacity * 2;
+    CallStats* stats = calloc(capacity, sizeof(CallStats));
+    if (stats == NULL) out_of_memory();
+
+    for (size_t i = 0; i < profiler->stats_capacity; i++) {
+      if (profiler->stats[i].callee == NULL) continue;
+      *find_slot(stats, capacity, profiler->stats[i].callee) = profiler->stats[i];
+    }
+
+    free(profiler->stats);
+    profiler->stats = stats;
+    profiler->stats_capacity = capacity;
+  }
+
+  CallStats* slot = find_slot(profiler->stats, profiler->stats_capacity, callee);
+
+  if (slot->callee == NULL) {
+    slot->callee = callee;
+    profiler->stats_count++;
+  }
+
+  return (size_t) (slot - profiler->stats);
+}
+
+static void enter(CallProfiler* profiler, Object* callee, int frame, uint64_t now) {
+  if (profiler->record_count + 1 > profiler->record_capacity) {
+    profiler->record_capacity = profiler->record_capacity < 64 ? 64 : profiler->record_capacity * 2;
+    profiler->records = grow(profiler->records, sizeof(CallRecord) * profiler->record_capacity);
+  }
+
+  // records only hold an index, the table may move while they are active
+  size_t index = stats_index(profiler, callee);
+  CallStats* stats = &profiler->stats[index];
+  stats->calls++;
+  stats->active++;
+
+  profiler->records[profiler->record_count++] = (CallRecord) {
+    .stats = index,
+    .frame = frame,
+    .start_ns = now,
+    .children_ns = 0,
+  };
+}
+
+static void leave(CallProfiler* profiler, uint64_t now) {
+  CallRecord* record = &profiler->records[--profiler->record_count];
+  CallStats* stats = &profiler->stats[record->stats];
+  uint64_t elapsed = now - record->start_ns;
+
+  stats->exclusive_ns += elapsed - record->children_ns;
+
+  // only the outermost activation of a recursive callee adds its time, the
+  // inner ones are already part of it
+  if (--stats->active == 0) stats->inclusive_ns += elapsed;
+
+  if (profiler->record_count > 0) {
+    profiler->records[profiler->record_count - 1].children_ns += elapsed;
+  }
+}
+
+void CallProfiler_init(CallProfiler* profiler) {
+  profiler->stats = NULL;
+  profiler->stats_count = 0;
+  profiler->stats_capacity = 0;
+  profiler->records = NULL;
+  profiler->record_count = 0;
+  profiler->record_capacity = 0;
+  profiler->frame_count = 0;
+}
+
+void CallProfiler_sync(CallProfiler* profiler, VM* vm) {
+  uint64_t now = now_ns();
+
+  // frames above a native belong to a run it started, and return before it
+  while (profiler->record_count > 0) {
+    CallRecord* top = &profiler->records[profiler->record_count - 1];
+    if (top->frame == NATIVE_FRAME || top->frame < vm->frame_count) break;
+    leave(profiler, now);
+  }
+
+  if (profiler->frame_count > vm->frame_count) profiler->frame_count = vm->frame_count;
+
+  for (; profiler->frame_count < vm->frame_count; profiler->frame_count++) {
+    ObjectFunction* function = vm->frames[profiler->frame_count].closure->function;
+    enter(profiler, (Object*) function, profiler->frame_count, now);
+  }
+}
+
+void CallProfiler_enter_native(CallProfiler* profiler, ObjectNativeFn* native) {
+  enter(profiler, (Object*) native, NATIVE_FRAME, now_ns());
+}
+
+void CallProfiler_exit_native(CallProfiler* profiler, VM* vm) {
+  CallProfiler_sync(profiler, vm);
+
+  while (profiler->record_count > 0) {
+    bool native = profiler->records[profiler->record_count - 1].frame == NATIVE_FRAME;
+    leave(profiler, now_ns());
+    if (native) break;
+  }
+}
+
+void CallProfiler_stop(CallProfiler* profiler) {
+  uint64_t now = now_ns();
+
+  while (profiler->record_count > 0) {
+    leave(profiler, now);
+  }
+
+  profiler->frame_count = 0;
+}
+
+static const char* callee_name(Object* callee) {
+  if (callee->type == OBJ_NATIVE_FN) return ((ObjectNativeFn*) callee)->name->chars;
+
+  ObjectFunction* function = (ObjectFunction*) callee;
+  return function->name != NULL ? function->name->chars : "script";
+}
+
+static size_t callee_line(Object* callee) {
+  if (callee->type == OBJ_NATIVE_FN) return 0;
+
+  ObjectFunction* function = (ObjectFunction*) callee;
+  if (function->chunk.count == 0) return 0;
+
+  return Chunk_get_line(&function->chunk, 0);
+}
+
+static int compare_stats(const void* a, const void* b) {
+  uint64_t x = (*(CallStats* const*) a)->exclusive_ns;
+  uint64_t y = (*(CallStats* const*) b)->exclusive_ns;
+  return (x < y) - (x > y);
+}
+
+/**
+ * Returns the stats of every callee, by exclusive time, in an array the
+ * caller frees.
+ */
+static CallStats** sorted_stats(CallProfiler* profiler) {
+  CallStats** sorted = grow(NULL, sizeof(CallStats*) * (profiler->stats_count + 1));
+  size_t count = 0;
+
+  for (size_t i = 0; i < profiler->stats_capacity; i++) {
+    if (profiler->stats[i].callee != NULL) sorted[count++] = &profiler->stats[i];
+  }
+
+  qsort(sorted, count, sizeof(CallStats*), compare_stats);
+  return sorted;
+}
+
+void CallProfiler_print(CallProfiler* profiler, FILE* file) {
+  CallStats** sorted = sorted_stats(profiler);
+  uint64_t total = 0;
+
+  for (size_t i = 0; i < profiler->stats_count; i++) {
+    total += sorted[i]->exclusive_ns;
+  }
+
+  fprintf(file, "%-32s %12s %14s %14s %7s\n",
+          "function", "calls", "inclusive ms", "exclusive ms", "self %");
+
+  for (size_t i = 0; i < profiler->stats_count; i++) {
+    CallStats* stats = sorted[i];
+    char name[64];
+
+    if (stats->callee->type == OBJ_NATIVE_FN) {
+      snprintf(name, sizeof(name), "%s (native)", callee_name(stats->callee));
+    } else {
+      snprintf(name, sizeof(name), "%s:%zu", callee_name(stats->callee), callee_line(stats->callee));
+    }
+
+    fprintf(file, "%-32s %12llu %14.3f %14.3f %6.2f%%\n", name,
+            (unsigned long long) stats->calls,
+            stats->inclusive_ns / 1e6, stats->exclusive_ns / 1e6,
+            total > 0 ? 100.0 * stats->exclusive_ns / total : 0.0);
+  }
+
+  free(sorted);
+}
+
+bool CallProfiler_write_json(CallProfiler* profiler, const char* path) {
+  FILE* file = fopen(path, "w");
+
+  if (file == NULL) {
+    fprintf(stderr, "Could not open file \"%s\"\n", path);
+    return false;
+  }
+
+  CallStats** sorted = sorted_stats(profiler);
+  fprintf(file, "[\n");
+
+  for (size_t i = 0; i < profiler->stats_count; i++) {
+    CallStats* stats = sorted[i];
+    bool native = stats->callee->type == OBJ_NATIVE_FN;
+
+    fprintf(file, "  {\"name\": ");
+    write_json_string(file, callee_name(stats->callee));
+    fprintf(file, ", \"native\": %s, \"line\": %zu, \"calls\": %llu, "
+                  "\"inclusive_ns\": %llu, \"exclusive_ns\": %llu}%s\n",
+            native ? "true" : "false", callee_line(stats->callee),
+            (unsigned long long) stats->calls,
+            (unsigned long long) stats->inclusive_ns,
+            (unsigned long long) stats->exclusive_ns,
+            i + 1 < profiler->stats_count ? "," : "");
+  }
+
+  fprintf(file, "]\n");
+  free(sorted);
+  fclose(file);
+  return true;
+}
+
+void CallProfiler_free(CallProfiler* profiler) {
+  free(profiler->stats);
+  free(profiler->records);
+  CallProfiler_init(profiler);
+}
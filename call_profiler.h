@@ -0,0 +1,86 @@
+#ifndef peach_call_profiler_h
+#define peach_call_profiler_h
+
+#include <stdio.h>
+
+#include "common.h"
+#include "object.h"
+
+struct VM;
+
+/**
+ * Totals of one function or native. Time spent in recursive activations
+ * counts once towards the inclusive time.
+ */
+typedef struct {
+  Object* callee;
+  uint64_t calls;
+  uint64_t inclusive_ns;
+  uint64_t exclusive_ns;
+
+  // Activations currently on the profiler's stack.
+  uint32_t active;
+} CallStats;
+
+/**
+ * An activation on the profiler's shadow stack. Frames of closures record
+ * the index of their VM frame; natives record -1.
+ */
+typedef struct {
+  size_t stats;
+  int frame;
+  uint64_t start_ns;
+  uint64_t children_ns;
+} CallRecord;
+
+/**
+ * A deterministic profiler of calls. It mirrors the VM's frames on a
+ * shadow stack, which the instrumented dispatch loop brings up to date
+ * whenever the number of frames changed, and natives are entered and
+ * exited around their call.
+ */
+typedef struct CallProfiler {
+  // Open addressing table of the stats, keyed by the callee.
+  CallStats* stats;
+  size_t stats_count;
+  size_t stats_capacity;
+
+  CallRecord* records;
+  size_t record_count;
+  size_t record_capacity;
+
+  // Number of VM frames the shadow stack covers.
+  int frame_count;
+} CallProfiler;
+
+void CallProfiler_init(CallProfiler* profiler);
+
+/**
+ * Ends the activations of frames which returned and starts those of frames
+ * which were pushed since the last call.
+ */
+void CallProfiler_sync(CallProfiler* profiler, struct VM* vm);
+
+void CallProfiler_enter_native(CallProfiler* profiler, ObjectNativeFn* native);
+void CallProfiler_exit_native(CallProfiler* profiler, struct VM* vm);
+
+/**
+ * Ends every activation still on the stack, such as those of frames a
+ * runtime error unwound.
+ */
+void CallProfiler_stop(CallProfiler* profiler);
+
+/**
+ * Writes a table of the callees sorted by exclusive time.
+ */
+void CallProfiler_print(CallProfiler* profiler, FILE* file);
+
+/**
+ * Writes the totals of every callee as a JSON array. Returns false if the
+ * file could not be written.
+ */
+bool CallProfiler_write_json(CallProfiler* profiler, const char* path);
+
+void CallProfiler_free(CallProfiler* profiler);
+
+#endif // !peach_call_profiler_h
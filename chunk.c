@@ -11,6 +11,12 @@ void Chunk_init(Chunk* chunk) {
   chunk->line_count = 0;
   chunk->lines = NULL;
 
+  chunk->caches = NULL;
+  chunk->cache_count = 0;
+  chunk->cache_capacity = 0;
+
+  chunk->call_caches = NULL;
+
   ValueArray_init(&chunk->constants);
 }
 
@@ -45,6 +51,17 @@ size_t Chunk_add_constant(Chunk* chunk, Value value) {
   return chunk->constants.count - 1;
 }
 
+size_t Chunk_add_cache(Chunk* chunk) {
+  if (chunk->cache_capacity < chunk->cache_count + 1) {
+    size_t old_capacity = chunk->cache_capacity;
+    chunk->cache_capacity = GROW_CAPACITY(old_capacity);
+    chunk->caches = GROW_ARRAY(PropertyCache, chunk->caches, old_capacity, chunk->cache_capacity);
+  }
+
+  chunk->caches[chunk->cache_count].count = 0;
+  return chunk->cache_count++;
+}
+
 void Chunk_write_constant(Chunk *chunk, Value value, size_t line) {
   size_t addr = Chunk_add_constant(chunk, value);
 
@@ -84,6 +101,8 @@ size_t Chunk_get_line(Chunk* chunk, size_t instruction) {
 void Chunk_free(Chunk* chunk) {
   FREE_ARRAY(uint8_t, chunk->code, chunk->capacity);
   FREE_ARRAY(LineStart, chunk->lines, chunk->line_capacity);
+  FREE_ARRAY(PropertyCache, chunk->caches, chunk->cache_capacity);
+  FREE_ARRAY(struct ObjectFunction*, chunk->call_caches, chunk->count);
   ValueArray_free(&chunk->constants);
 
   Chunk_init(chunk);
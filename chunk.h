@@ -38,7 +38,23 @@ typedef enum {
   OP_DIV,
   OP_NOT,
 
+  OP_INT_DIV,
+  OP_MOD,
+  OP_BIT_AND,
+  OP_BIT_OR,
+  OP_BIT_XOR,
+  OP_BIT_NOT,
+  OP_SHIFT_LEFT,
+  OP_SHIFT_RIGHT,
+
   OP_POP,
+
+  // Stack shuffles of inlined calls. OP_PEEK pushes a copy of the value its
+  // operand slots below the top, OP_POP_UNDER drops that many values from
+  // beneath the top one.
+  OP_PEEK,
+  OP_POP_UNDER,
+
   OP_PRINT,
   OP_RETURN,
 
@@ -46,11 +62,77 @@ typedef enum {
   OP_JUMP_IF_FALSE,
   OP_LOOP,
 
+  // Numeric for-loops. Both take the slot of the counter, which is followed
+  // by the limit and the step, and a 2-byte jump. OP_FOR_PREP jumps forward
+  // past the loop if it runs no iterations, OP_FOR_LOOP steps the counter
+  // and jumps back to the body while it hasn't reached the limit.
+  OP_FOR_PREP,
+  OP_FOR_LOOP,
+
   OP_CALL,
   OP_CLOSURE,
   OP_CLOSE_UPVALUE,
+
+  OP_IMPORT,
+  OP_IMPORT_LONG,
+
+  // Class operations take the name constant as a 3-byte operand. Property
+  // accesses are followed by a 2-byte index into the chunk's caches.
+  OP_CLASS,
+  OP_INHERIT,
+  OP_METHOD,
+  OP_GET_PROPERTY,
+  OP_SET_PROPERTY,
+  OP_INVOKE,
+  OP_GET_SUPER,
+  OP_SUPER_INVOKE,
 } OpCode;
 
+/**
+ * How OP_CLOSURE obtains each upvalue, given by the first byte of its
+ * capture pairs. The second byte is a local slot or an upvalue index of the
+ * enclosing closure.
+ *
+ * Variables which are never assigned after their declaration are captured
+ * by value into a closed cell owned by the closure, which skips the open
+ * upvalue list entirely.
+ */
+typedef enum {
+  CAPTURE_UPVALUE,
+  CAPTURE_LOCAL,
+  CAPTURE_LOCAL_VALUE,
+  CAPTURE_UPVALUE_VALUE,
+} CaptureKind;
+
+static inline bool capture_is_local(uint8_t kind) {
+  return kind == CAPTURE_LOCAL || kind == CAPTURE_LOCAL_VALUE;
+}
+
+// Number of shapes a property cache remembers before the site is treated
+// as megamorphic and always takes the slow path.
+#define PROPERTY_CACHE_WAYS 4
+
+struct ObjectShape;
+struct ObjectClosure;
+struct ObjectFunction;
+
+/**
+ * Where a property access site found its property for instances of one
+ * shape: a field slot, or a method of the shape's class. Stores which add a
+ * field also record the shape the instance moves to.
+ */
+typedef struct {
+  struct ObjectShape* shape;
+  uint32_t slot;
+  struct ObjectShape* transition;
+  struct ObjectClosure* method;
+} PropertyCacheEntry;
+
+typedef struct {
+  PropertyCacheEntry entries[PROPERTY_CACHE_WAYS];
+  uint8_t count;
+} PropertyCache;
+
 typedef struct {
   size_t line;
   size_t offset;
@@ -66,6 +148,17 @@ typedef struct {
   LineStart* lines;
   size_t line_count;
   size_t line_capacity;
+
+  // Inline caches of the chunk's property access sites.
+  PropertyCache* caches;
+  size_t cache_count;
+  size_t cache_capacity;
+
+  // Call site caches, indexed by the offset of the OP_CALL instruction:
+  // the function of the closure the site last called, whose arity is known
+  // to match the site. Allocated by the VM, `count` entries long, when the
+  // chunk first makes a call.
+  struct ObjectFunction** call_caches;
 } Chunk;
 
 void Chunk_init(Chunk* chunkl);
@@ -78,6 +171,11 @@ size_t Chunk_get_line(Chunk* chunk, size_t instruction);
 
 size_t Chunk_add_constant(Chunk *chunk, Value value);
 
+/**
+ * Adds an empty property cache to the chunk and returns its index.
+ */
+size_t Chunk_add_cache(Chunk* chunk);
+
 void Chunk_free(Chunk* chunk);
 
 #endif /* ifndef peach_chunk_h */
@@ -5,11 +5,6 @@
 #include <stddef.h>
 #include <stdint.h>
 
-#define DEBUG_PRINT_CODE
-#define DEBUG_TRACE_EXECUTION
-#define DEBUG_STRESS_GC
-#define DEBUG_LOG_GC
-
 #define UINT8_COUNT (UINT8_MAX + 1)
 
 #endif // !clocx_common_h
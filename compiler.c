@@ -1,3 +1,4 @@
+#include <errno.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -7,6 +8,7 @@
 #include "common.h"
 #include "compiler.h"
 #include "debug.h"
+#include "event_trace.h"
 #include "scanner.h"
 #include "value.h"
 #include "object.h"
@@ -14,24 +16,74 @@
 #include "memory.h"
 
 
+/**
+ * Where OP_CLOSURE captures a variable: the offset of the capture kind byte
+ * in `function`'s chunk.
+ */
+typedef struct {
+  ObjectFunction* function;
+  size_t offset;
+} CaptureSite;
+
 typedef struct {
   Token name;
   int depth;
   bool is_captured;
+
+  // Set by any assignment after the declaration. Captures of variables
+  // which are never assigned are patched to copy the value instead.
+  bool is_assigned;
+
+  // Every capture of the variable, including those of closures nested
+  // further in, which copy it from their enclosing closure.
+  CaptureSite* sites;
+  size_t site_count;
+  size_t site_capacity;
+
+  // The function of an inline declaration whose calls can be replaced
+  // with its body, see inline_call().
+  ObjectFunction* inline_function;
 } Local;
 
 typedef enum {
   TYPE_FUNCTION,
+  TYPE_INITIALIZER,
+  TYPE_METHOD,
   TYPE_SCRIPT
 } FunctionType;
 
 
+typedef struct Compiler Compiler;
+
 typedef struct {
   bool is_local;
   int index;
+
+  // The local variable the upvalue ultimately refers to.
+  Compiler* owner;
+  int local;
 } Upvalue;
 
-typedef struct Compiler Compiler;
+/**
+ * A global inline function. Redeclaring the global forgets it.
+ */
+typedef struct {
+  Token name;
+  ObjectFunction* function;
+} InlineGlobal;
+
+// Largest function body, in bytes of code, which is substituted for calls.
+#define INLINE_MAX_CODE 32
+
+/**
+ * An entry of a compiler's constant index. Empty entries hold nil, which is
+ * never stored in a constant pool.
+ */
+typedef struct {
+  Value value;
+  size_t index;
+} ConstantEntry;
+
 struct Compiler {
   Compiler* enclosing;
   ObjectFunction* function;
@@ -43,8 +95,23 @@ struct Compiler {
   int scope_depth;
 
   Upvalue upvalues[UINT8_COUNT];
+
+  // Maps the constants of the function's pool to their index, so each
+  // distinct constant is stored once.
+  ConstantEntry* constants;
+  size_t constant_count;
+  size_t constant_capacity;
 };
 
+/**
+ * The class whose body is being compiled, used to resolve `this` and
+ * `super`.
+ */
+typedef struct ClassCompiler {
+  struct ClassCompiler* enclosing;
+  bool has_superclass;
+} ClassCompiler;
+
 typedef struct {
   Scanner* scanner;
   const char* source;
@@ -57,6 +124,11 @@ typedef struct {
   VM* vm;
 
   Compiler* current_compiler;
+  ClassCompiler* current_class;
+
+  InlineGlobal* inline_globals;
+  size_t inline_global_count;
+  size_t inline_global_capacity;
 } Parser;
 
 typedef enum {
@@ -66,6 +138,10 @@ typedef enum {
   PREC_AND,
   PREC_EQUALITY,
   PREC_COMPARISON,
+  PREC_BIT_OR,
+  PREC_BIT_XOR,
+  PREC_BIT_AND,
+  PREC_SHIFT,
   PREC_TERM,
   PREC_FACTOR,
   PREC_UNARY,
@@ -91,6 +167,9 @@ static void literal(Parser* parser, bool can_assign);
 static void string(Parser* parser, bool can_assign);
 static void variable(Parser* parser, bool can_assign);
 static void call(Parser* parser, bool can_assign);
+static void dot(Parser* parser, bool can_assign);
+static void this_(Parser* parser, bool can_assign);
+static void super_(Parser* parser, bool can_assign);
 
 static void expression(Parser* parser);
 static void declaration(Parser* parser);
@@ -99,12 +178,18 @@ static void block(Parser* parser);
 static void print_statement(Parser* parser);
 static void if_statement(Parser* parser);
 static void while_statement(Parser* parser);
+static void for_statement(Parser* parser);
 static void expression_statement(Parser* parser);
 static void fn_declaration(Parser* parser);
+static void inline_declaration(Parser* parser);
+static void class_declaration(Parser* parser);
 static void var_declaration(Parser* parser);
 static void return_statement(Parser* parser);
+static void import_statement(Parser* parser);
 
 static void named_variable(Parser* parser, Token name, bool can_assign);
+static ObjectFunction* resolve_inline(Parser* parser, Token* name);
+static void forget_inline_global(Parser* parser, Token* name);
 static size_t identifier_constant(Parser* parser, Token name);
 static size_t parse_variable(Parser* parser, const char* err);
 static void define_variable(Parser* parser, size_t global);
@@ -122,6 +207,7 @@ static void emit_bytes(Parser* parser, uint8_t byte1, uint8_t byte2);
 static void emit_return(Parser* parser);
 static void emit_addr_bytes(Parser* parser, uint8_t short_op, uint8_t long_op, size_t addr);
 static void emit_constant(Parser* parser, Value value);
+static size_t make_constant(Parser* parser, Value value);
 static size_t emit_jump(Parser* parser, OpCode op);
 static ObjectFunction* end_compiler(Parser* parser);
 static void begin_scope(Parser* parser);
@@ -137,8 +223,10 @@ static void error_at(Parser* parser, Token* token, const char* message);
 static void error_at_current(Parser* parser, const char* message);
 static void error(Parser* parser, const char* message);
 
-static void Compiler_init(Compiler* compiler, Parser* parser, FunctionType type);
+static void Compiler_init(Compiler* compiler, Parser* parser, FunctionType type,
+                          ObjectFunction* function);
 static void Compiler_free(Compiler* compiler);
+static void release_local(Local* local);
 
 ParseRule rules[] = {
   [TOKEN_LEFT_PAREN]    = {grouping, call,   PREC_CALL},
@@ -146,20 +234,29 @@ ParseRule rules[] = {
   [TOKEN_LEFT_BRACE]    = {NULL,     NULL,   PREC_NONE}, 
   [TOKEN_RIGHT_BRACE]   = {NULL,     NULL,   PREC_NONE},
   [TOKEN_COMMA]         = {NULL,     NULL,   PREC_NONE},
-  [TOKEN_DOT]           = {NULL,     NULL,   PREC_NONE},
+  [TOKEN_DOT]           = {NULL,     dot,    PREC_CALL},
+  [TOKEN_DOT_DOT]       = {NULL,     NULL,   PREC_NONE},
   [TOKEN_MINUS]         = {unary,    binary, PREC_TERM},
   [TOKEN_PLUS]          = {NULL,     binary, PREC_TERM},
   [TOKEN_SEMICOLON]     = {NULL,     NULL,   PREC_NONE},
   [TOKEN_SLASH]         = {NULL,     binary, PREC_FACTOR},
   [TOKEN_STAR]          = {NULL,     binary, PREC_FACTOR},
+  [TOKEN_PERCENT]       = {NULL,     binary, PREC_FACTOR},
+  [TOKEN_AMPERSAND]     = {NULL,     binary, PREC_BIT_AND},
+  [TOKEN_PIPE]          = {NULL,     binary, PREC_BIT_OR},
+  [TOKEN_CARET]         = {NULL,     binary, PREC_BIT_XOR},
+  [TOKEN_TILDE]         = {unary,    NULL,   PREC_NONE},
+  [TOKEN_TILDE_SLASH]   = {NULL,     binary, PREC_FACTOR},
   [TOKEN_BANG]          = {unary,    NULL,   PREC_NONE},
   [TOKEN_BANG_EQUAL]    = {NULL,     binary, PREC_EQUALITY},
   [TOKEN_EQUAL]         = {NULL,     NULL,   PREC_NONE},
   [TOKEN_EQUAL_EQUAL]   = {NULL,     binary, PREC_EQUALITY},
   [TOKEN_GREATER]       = {NULL,     binary, PREC_COMPARISON},
   [TOKEN_GREATER_EQUAL] = {NULL,     binary, PREC_COMPARISON},
+  [TOKEN_GREATER_GREATER] = {NULL,   binary, PREC_SHIFT},
   [TOKEN_LESS]          = {NULL,     binary, PREC_COMPARISON},
   [TOKEN_LESS_EQUAL]    = {NULL,     binary, PREC_COMPARISON},
+  [TOKEN_LESS_LESS]     = {NULL,     binary, PREC_SHIFT},
   [TOKEN_LET]           = {NULL,     NULL,   PREC_NONE},
   [TOKEN_IDENTIFIER]    = {variable, NULL,   PREC_NONE},
   [TOKEN_STRING]        = {string,   NULL,   PREC_NONE},
@@ -171,12 +268,15 @@ ParseRule rules[] = {
   [TOKEN_FOR]           = {NULL,     NULL,   PREC_NONE},
   [TOKEN_FN]            = {NULL,     NULL,   PREC_NONE},
   [TOKEN_IF]            = {NULL,     NULL,   PREC_NONE},
+  [TOKEN_IMPORT]        = {NULL,     NULL,   PREC_NONE},
+  [TOKEN_IN]            = {NULL,     NULL,   PREC_NONE},
+  [TOKEN_INLINE]        = {NULL,     NULL,   PREC_NONE},
   [TOKEN_NIL]           = {literal,  NULL,   PREC_NONE},
   [TOKEN_OR]            = {NULL,     or_,    PREC_OR},
   [TOKEN_PRINT]         = {NULL,     NULL,   PREC_NONE},
   [TOKEN_RETURN]        = {NULL,     NULL,   PREC_NONE},
-  [TOKEN_SUPER]         = {NULL,     NULL,   PREC_NONE},
-  [TOKEN_THIS]          = {NULL,     NULL,   PREC_NONE},
+  [TOKEN_SUPER]         = {super_,   NULL,   PREC_NONE},
+  [TOKEN_THIS]          = {this_,    NULL,   PREC_NONE},
   [TOKEN_TRUE]          = {literal,  NULL,   PREC_NONE},
   [TOKEN_WHILE]         = {NULL,     NULL,   PREC_NONE},
   [TOKEN_ERROR]         = {NULL,     NULL,   PREC_NONE},
@@ -194,6 +294,7 @@ static void error_at(Parser* parser, Token* token, const char* message) {
   if (parser->panic_mode) return;
 
   parser->panic_mode = true;
+  Output_flush(&parser->vm->out);
   fprintf(stderr, "[line %zu] Error", token->line);
 
   if (token->type == TOKEN_EOF) {
@@ -256,13 +357,17 @@ static void emit_bytes(Parser* parser, uint8_t byte1, uint8_t byte2) {
 }
 
 static void emit_return(Parser* parser) {
-  emit_byte(parser, OP_NIL);
+  // initializers return the instance
+  if (parser->current_compiler->type == TYPE_INITIALIZER) {
+    emit_bytes(parser, OP_GET_LOCAL, 0);
+  } else {
+    emit_byte(parser, OP_NIL);
+  }
+
   emit_byte(parser, OP_RETURN);
 }
 
-static size_t emit_jump(Parser* parser, OpCode op) {
-  emit_byte(parser, op);
-
+static size_t emit_jump_operand(Parser* parser) {
   // emit placeholder location which will be patched later
   // see: patch_jump
   emit_byte(parser, 0xff);
@@ -270,6 +375,11 @@ static size_t emit_jump(Parser* parser, OpCode op) {
   return current_chunk(parser)->count - 2;
 }
 
+static size_t emit_jump(Parser* parser, OpCode op) {
+  emit_byte(parser, op);
+  return emit_jump_operand(parser);
+}
+
 /**
  * Emit bytes for constants addressing.
  * Emits `short_op` if `addr` can be packed as a single byte operand.
@@ -285,23 +395,129 @@ static void emit_addr_bytes(Parser* parser, uint8_t short_op, uint8_t long_op, s
   emit_bytes(parser, (addr >>  8) & 0xff, (addr >> 16) & 0xff);
 }
 
+/**
+ * Emits an instruction taking a constant as a fixed 3-byte operand.
+ */
+static void emit_long_operand(Parser* parser, uint8_t op, size_t constant) {
+  emit_bytes(parser, op, (constant >>  0) & 0xff);
+  emit_bytes(parser, (constant >>  8) & 0xff, (constant >> 16) & 0xff);
+}
+
+/**
+ * Emits the 2-byte index of a new property cache for the access site being
+ * emitted.
+ */
+static void emit_cache(Parser* parser) {
+  size_t cache = Chunk_add_cache(current_chunk(parser));
+
+  if (cache > UINT16_MAX) {
+    error(parser, "Too many property accesses in one function.");
+  }
+
+  emit_bytes(parser, (cache >> 0) & 0xff, (cache >> 8) & 0xff);
+}
+
 static void emit_constant(Parser* parser, Value value) {
-  Chunk_write_constant(current_chunk(parser), value, parser->previous.line);
+  emit_addr_bytes(parser, OP_LOAD_CONST, OP_LOAD_CONST_LONG, make_constant(parser, value));
+}
+
+static uint32_t hash_constant(Value value) {
+  uint64_t bits;
+
+  if (IS_NUMBER(value)) {
+    memcpy(&bits, &AS_NUMBER(value), sizeof(bits));
+  } else if (IS_INT(value)) {
+    bits = (uint64_t) AS_INT(value);
+  } else {
+    bits = (uint64_t) (uintptr_t) AS_OBJECT(value);
+  }
+
+  bits ^= bits >> 33;
+  bits *= 0xff51afd7ed558ccdull;
+  bits ^= bits >> 33;
+  return (uint32_t) bits;
+}
+
+static bool constant_equals(Value a, Value b) {
+  if (a.type != b.type) return false;
+
+  // Compared bit for bit so 0 and -0 get separate entries.
+  if (IS_NUMBER(a)) return memcmp(&AS_NUMBER(a), &AS_NUMBER(b), sizeof(double)) == 0;
+  if (IS_INT(a)) return AS_INT(a) == AS_INT(b);
+  return AS_OBJECT(a) == AS_OBJECT(b);
+}
+
+static ConstantEntry* find_constant(ConstantEntry* entries, size_t capacity, Value value) {
+  size_t index = hash_constant(value) & (capacity - 1);
+
+  for (;;) {
+    ConstantEntry* entry = &entries[index];
+    if (IS_NIL(entry->value) || constant_equals(entry->value, value)) return entry;
+
+    index = (index + 1) & (capacity - 1);
+  }
+}
+
+/**
+ * Adds a number or object constant to the current chunk, unless it already
+ * holds the same value, and returns its index.
+ */
+static size_t make_constant(Parser* parser, Value value) {
+  Compiler* compiler = parser->current_compiler;
+
+  if (compiler->constant_count + 1 > compiler->constant_capacity * 3 / 4) {
+    size_t capacity = GROW_CAPACITY(compiler->constant_capacity);
+    ConstantEntry* entries = ALLOCATE(ConstantEntry, capacity);
+
+    for (size_t i = 0; i < capacity; i++) {
+      entries[i].value = NIL_VAL;
+    }
+
+    for (size_t i = 0; i < compiler->constant_capacity; i++) {
+      ConstantEntry* entry = &compiler->constants[i];
+      if (IS_NIL(entry->value)) continue;
+
+      *find_constant(entries, capacity, entry->value) = *entry;
+    }
+
+    FREE_ARRAY(ConstantEntry, compiler->constants, compiler->constant_capacity);
+    compiler->constants = entries;
+    compiler->constant_capacity = capacity;
+  }
+
+  ConstantEntry* entry = find_constant(compiler->constants, compiler->constant_capacity, value);
+
+  if (IS_NIL(entry->value)) {
+    entry->value = value;
+    entry->index = Chunk_add_constant(current_chunk(parser), value);
+    compiler->constant_count++;
+  }
+
+  return entry->index;
 }
 
 static ObjectFunction* end_compiler(Parser* parser) {
   emit_return(parser);
   ObjectFunction* function = parser->current_compiler->function;
 
-  #ifdef DEBUG_PRINT_CODE
-  if (!parser->had_error) {
+  if (debug_flags.print_code && !parser->had_error) {
     disassemble_chunk(current_chunk(parser),
                       function->name != NULL ? function->name->chars : "code");
   }
-  #endif
+
+  if (event_trace != NULL) {
+    EventTrace_end(event_trace, "compile",
+                   function->name != NULL ? function->name->chars : "script");
+  }
 
 
   Compiler* compiler = parser->current_compiler;
+
+  // the rest of the function's locals go out of scope with its frame
+  for (size_t i = 0; i < compiler->local_count; i++) {
+    release_local(&compiler->locals[i]);
+  }
+
   parser->current_compiler = compiler->enclosing;
   Compiler_free(compiler);
 
@@ -321,11 +537,16 @@ static void end_scope(Parser* parser) {
   while (
     compiler->local_count > 0 &&
     compiler->locals[compiler->local_count - 1].depth > compiler->scope_depth) {
-      if (compiler->locals[compiler->local_count - 1].is_captured) {
+      Local* local = &compiler->locals[compiler->local_count - 1];
+
+      // variables captured by value have nothing to close
+      if (local->is_captured && local->is_assigned) {
         emit_byte(parser, OP_CLOSE_UPVALUE);
       } else {
         emit_byte(parser, OP_POP);
       }
+
+      release_local(local);
       compiler->local_count--;
   }
 }
@@ -361,8 +582,24 @@ static void expression(Parser* parser) {
   parse_precedence(parser, PREC_ASSIGNMENT);
 }
 
+/**
+ * Literals without a fraction are integers, unless they do not fit into 64
+ * bits.
+ */
 static void number(Parser* parser, bool can_assign) {
-  double value = strtod(parser->previous.start, NULL);
+  const char* start = parser->previous.start;
+
+  if (memchr(start, '.', parser->previous.length) == NULL) {
+    errno = 0;
+    long long value = strtoll(start, NULL, 10);
+
+    if (errno != ERANGE) {
+      emit_constant(parser, INT_VAL(value));
+      return;
+    }
+  }
+
+  double value = strtod(start, NULL);
   emit_constant(parser, NUMBER_VAL(value));
 }
 
@@ -404,6 +641,10 @@ static void unary(Parser* parser, bool can_assign) {
       emit_byte(parser, OP_NOT);
       break;
 
+    case TOKEN_TILDE:
+      emit_byte(parser, OP_BIT_NOT);
+      break;
+
     default:
       return; // Unreachable
   }
@@ -451,6 +692,65 @@ static void call(Parser* parser, bool can_assign) {
   emit_bytes(parser, OP_CALL, arg_count);
 }
 
+static void dot(Parser* parser, bool can_assign) {
+  Parser_consume(parser, TOKEN_IDENTIFIER, "Expect property name after '.'.");
+  size_t name = identifier_constant(parser, parser->previous);
+
+  if (can_assign && Parser_match(parser, TOKEN_EQUAL)) {
+    expression(parser);
+    emit_long_operand(parser, OP_SET_PROPERTY, name);
+    emit_cache(parser);
+  } else if (Parser_match(parser, TOKEN_LEFT_PAREN)) {
+    uint8_t arg_count = argument_list(parser);
+    emit_long_operand(parser, OP_INVOKE, name);
+    emit_byte(parser, arg_count);
+    emit_cache(parser);
+  } else {
+    emit_long_operand(parser, OP_GET_PROPERTY, name);
+    emit_cache(parser);
+  }
+}
+
+static Token synthetic_token(const char* text) {
+  Token token;
+  token.start = text;
+  token.length = strlen(text);
+  return token;
+}
+
+static void this_(Parser* parser, bool can_assign) {
+  if (parser->current_class == NULL) {
+    error(parser, "Can't use 'this' outside of a class.");
+    return;
+  }
+
+  variable(parser, false);
+}
+
+static void super_(Parser* parser, bool can_assign) {
+  if (parser->current_class == NULL) {
+    error(parser, "Can't use 'super' outside of a class.");
+  } else if (!parser->current_class->has_superclass) {
+    error(parser, "Can't use 'super' in a class with no superclass.");
+  }
+
+  Parser_consume(parser, TOKEN_DOT, "Expect '.' after 'super'.");
+  Parser_consume(parser, TOKEN_IDENTIFIER, "Expect superclass method name.");
+  size_t name = identifier_constant(parser, parser->previous);
+
+  named_variable(parser, synthetic_token("this"), false);
+
+  if (Parser_match(parser, TOKEN_LEFT_PAREN)) {
+    uint8_t arg_count = argument_list(parser);
+    named_variable(parser, synthetic_token("super"), false);
+    emit_long_operand(parser, OP_SUPER_INVOKE, name);
+    emit_byte(parser, arg_count);
+  } else {
+    named_variable(parser, synthetic_token("super"), false);
+    emit_long_operand(parser, OP_GET_SUPER, name);
+  }
+}
+
 static void binary(Parser* parser, bool can_assign) {
   TokenType op_type = parser->previous.type;
   ParseRule* rule = get_rule(op_type);
@@ -469,6 +769,14 @@ static void binary(Parser* parser, bool can_assign) {
     case TOKEN_STAR:  emit_byte(parser, OP_MUL); break;
     case TOKEN_SLASH: emit_byte(parser, OP_DIV); break;
 
+    case TOKEN_TILDE_SLASH:     emit_byte(parser, OP_INT_DIV); break;
+    case TOKEN_PERCENT:         emit_byte(parser, OP_MOD); break;
+    case TOKEN_AMPERSAND:       emit_byte(parser, OP_BIT_AND); break;
+    case TOKEN_PIPE:            emit_byte(parser, OP_BIT_OR); break;
+    case TOKEN_CARET:           emit_byte(parser, OP_BIT_XOR); break;
+    case TOKEN_LESS_LESS:       emit_byte(parser, OP_SHIFT_LEFT); break;
+    case TOKEN_GREATER_GREATER: emit_byte(parser, OP_SHIFT_RIGHT); break;
+
     default: return; // Unreachable
   }
 }
@@ -481,10 +789,177 @@ static void string(Parser* parser, bool can_assign) {
   emit_constant(parser, value);
 }
 
+/**
+ * Substitutes the body of an inline function for a call to it, or checks
+ * whether that's possible if `emit` is false. The body has to be a single
+ * return of a straight-line expression over the parameters, constants and
+ * globals, without calls, captures or locals of its own.
+ *
+ * The arguments are already on the stack, in place of the callee's slots.
+ * Reads of a parameter become an OP_PEEK at the depth the argument is
+ * found at, and the arguments are dropped from under the result at the end.
+ */
+static bool inline_body(Parser* parser, ObjectFunction* function, bool emit) {
+  Chunk* body = &function->chunk;
+  const uint8_t* code = body->code;
+  Token call_end = parser->previous;
+  int height = 0;
+
+  for (size_t offset = 0; offset < body->count && offset < INLINE_MAX_CODE;) {
+    uint8_t op = code[offset];
+
+    // inlined instructions keep the lines of the body so runtime errors
+    // point into it
+    parser->previous.line = Chunk_get_line(body, offset);
+
+    switch (op) {
+      case OP_GET_LOCAL: {
+        uint8_t slot = code[offset + 1];
+        int distance = function->arity - slot + height;
+
+        if (slot == 0 || slot > function->arity || distance > UINT8_MAX) {
+          parser->previous = call_end;
+          return false;
+        }
+
+        if (emit) emit_bytes(parser, OP_PEEK, distance);
+
+        height++;
+        offset += 2;
+        break;
+      }
+
+      case OP_LOAD_CONST:
+      case OP_LOAD_CONST_LONG:
+      case OP_GET_GLOBAL:
+      case OP_GET_GLOBAL_LONG: {
+        bool is_long = op == OP_LOAD_CONST_LONG || op == OP_GET_GLOBAL_LONG;
+        size_t index = code[offset + 1];
+        if (is_long) index |= (code[offset + 2] << 8) | (code[offset + 3] << 16);
+
+        if (emit) {
+          size_t constant = make_constant(parser, body->constants.values[index]);
+
+          if (op == OP_LOAD_CONST || op == OP_LOAD_CONST_LONG) {
+            emit_addr_bytes(parser, OP_LOAD_CONST, OP_LOAD_CONST_LONG, constant);
+          } else {
+            emit_addr_bytes(parser, OP_GET_GLOBAL, OP_GET_GLOBAL_LONG, constant);
+          }
+        }
+
+        height++;
+        offset += is_long ? 4 : 2;
+        break;
+      }
+
+      case OP_NIL:
+      case OP_TRUE:
+      case OP_FALSE:
+        height++;
+        // fallthrough
+
+      case OP_NEGATE:
+      case OP_NOT:
+      case OP_BIT_NOT:
+        if (emit) emit_byte(parser, op);
+        offset++;
+        break;
+
+      case OP_EQUAL:
+      case OP_GREATER:
+      case OP_LESS:
+      case OP_ADD:
+      case OP_SUB:
+      case OP_MUL:
+      case OP_DIV:
+      case OP_INT_DIV:
+      case OP_MOD:
+      case OP_BIT_AND:
+      case OP_BIT_OR:
+      case OP_BIT_XOR:
+      case OP_SHIFT_LEFT:
+      case OP_SHIFT_RIGHT:
+        if (emit) emit_byte(parser, op);
+        height--;
+        offset++;
+        break;
+
+      case OP_RETURN:
+        parser->previous = call_end;
+
+        if (emit && function->arity > 0) {
+          emit_bytes(parser, OP_POP_UNDER, function->arity);
+        }
+
+        return height == 1;
+
+      default:
+        parser->previous = call_end;
+        return false;
+    }
+  }
+
+  parser->previous = call_end;
+  return false;
+}
+
+static void inline_call(Parser* parser, ObjectFunction* function) {
+  uint8_t arg_count = argument_list(parser);
+
+  if (arg_count != function->arity) {
+    error(parser, "Wrong number of arguments to inline function.");
+    return;
+  }
+
+  inline_body(parser, function, true);
+}
+
 static void variable(Parser* parser, bool can_assign) {
+  if (Parser_check(parser, TOKEN_LEFT_PAREN)) {
+    ObjectFunction* function = resolve_inline(parser, &parser->previous);
+
+    if (function != NULL) {
+      Parser_advance(parser);
+      inline_call(parser, function);
+      return;
+    }
+  }
+
   named_variable(parser, parser->previous, can_assign);
 }
 
+/**
+ * Called once a local's scope has been compiled, when all its assignments
+ * and captures are known. If it was never assigned, every capture of it is
+ * patched to copy its value.
+ */
+static void release_local(Local* local) {
+  if (local->is_captured && !local->is_assigned) {
+    for (size_t i = 0; i < local->site_count; i++) {
+      uint8_t* kind = &local->sites[i].function->chunk.code[local->sites[i].offset];
+      *kind = *kind == CAPTURE_LOCAL ? CAPTURE_LOCAL_VALUE : CAPTURE_UPVALUE_VALUE;
+    }
+  }
+
+  FREE_ARRAY(CaptureSite, local->sites, local->site_capacity);
+  local->sites = NULL;
+  local->site_count = 0;
+  local->site_capacity = 0;
+  local->inline_function = NULL;
+}
+
+static void add_capture_site(Local* local, ObjectFunction* function, size_t offset) {
+  if (local->site_capacity < local->site_count + 1) {
+    size_t old_capacity = local->site_capacity;
+    local->site_capacity = GROW_CAPACITY(old_capacity);
+    local->sites = GROW_ARRAY(CaptureSite, local->sites, old_capacity, local->site_capacity);
+  }
+
+  local->sites[local->site_count].function = function;
+  local->sites[local->site_count].offset = offset;
+  local->site_count++;
+}
+
 static uint8_t add_upvalue(Parser* parser, Compiler* compiler, int index, bool is_local) {
   uint8_t upvalue_count = compiler->function->upvalue_count;
 
@@ -502,8 +977,18 @@ static uint8_t add_upvalue(Parser* parser, Compiler* compiler, int index, bool i
     return 0;
   }
 
-  compiler->upvalues[upvalue_count].is_local = is_local;
-  compiler->upvalues[upvalue_count].index = index;
+  Upvalue* upvalue = &compiler->upvalues[upvalue_count];
+  upvalue->is_local = is_local;
+  upvalue->index = index;
+
+  if (is_local) {
+    upvalue->owner = compiler->enclosing;
+    upvalue->local = index;
+  } else {
+    upvalue->owner = compiler->enclosing->upvalues[index].owner;
+    upvalue->local = compiler->enclosing->upvalues[index].local;
+  }
+
   return compiler->function->upvalue_count++;
 }
 
@@ -549,13 +1034,58 @@ static void named_variable(Parser* parser, Token name, bool can_assign) {
 
 
   if (can_assign && Parser_match(parser, TOKEN_EQUAL)) {
+    if (resolve_inline(parser, &name) != NULL) {
+      error(parser, "Can't assign to an inline function.");
+    }
+
     expression(parser);
     emit_addr_bytes(parser, set_op, set_op_long, addr);
+
+    if (set_op == OP_SET_LOCAL) {
+      parser->current_compiler->locals[addr].is_assigned = true;
+    } else if (set_op == OP_SET_UPVALUE) {
+      Upvalue* upvalue = &parser->current_compiler->upvalues[addr];
+      upvalue->owner->locals[upvalue->local].is_assigned = true;
+    }
   } else {
     emit_addr_bytes(parser, get_op, get_op_long, addr);
   }
 }
 
+/**
+ * Finds the inline function `name` refers to, if any. Enclosing functions
+ * are searched as well, since inlining a function doesn't capture it.
+ */
+static ObjectFunction* resolve_inline(Parser* parser, Token* name) {
+  for (Compiler* compiler = parser->current_compiler; compiler != NULL;
+       compiler = compiler->enclosing) {
+    for (size_t i = compiler->local_count; i-- > 0;) {
+      Local* local = &compiler->locals[i];
+
+      if (identifier_equals(name, &local->name)) {
+        return local->depth != -1 ? local->inline_function : NULL;
+      }
+    }
+  }
+
+  for (size_t i = 0; i < parser->inline_global_count; i++) {
+    if (identifier_equals(name, &parser->inline_globals[i].name)) {
+      return parser->inline_globals[i].function;
+    }
+  }
+
+  return NULL;
+}
+
+static void forget_inline_global(Parser* parser, Token* name) {
+  for (size_t i = 0; i < parser->inline_global_count; i++) {
+    if (identifier_equals(name, &parser->inline_globals[i].name)) {
+      parser->inline_globals[i] = parser->inline_globals[--parser->inline_global_count];
+      return;
+    }
+  }
+}
+
 static int resolve_local(Parser* parser, Compiler* compiler, Token* name) {
   if (!compiler->local_count) return -1;
 
@@ -654,6 +1184,73 @@ static void while_statement(Parser* parser) {
   emit_byte(parser, OP_POP);
 }
 
+/**
+ * for name in start..limit [step s] { ... }
+ *
+ * Counts from `start` up to, but not including, `limit`, or down to it if
+ * the step is negative. The counter, limit and step live in consecutive
+ * locals and the loop is driven by OP_FOR_PREP and OP_FOR_LOOP. `step` is
+ * only a keyword in this position.
+ */
+static void for_statement(Parser* parser) {
+  Compiler* compiler = parser->current_compiler;
+  begin_scope(parser);
+
+  Parser_consume(parser, TOKEN_IDENTIFIER, "Expect loop variable name after 'for'.");
+  Token name = parser->previous;
+  Parser_consume(parser, TOKEN_IN, "Expect 'in' after loop variable.");
+
+  // the loop variable is only named once the range has been compiled, so
+  // the limit and step can still read an outer variable of the same name
+  expression(parser);
+  add_local(parser, synthetic_token(""));
+  size_t slot = compiler->local_count - 1;
+
+  Parser_consume(parser, TOKEN_DOT_DOT, "Expect '..' after loop start.");
+  expression(parser);
+  add_local(parser, synthetic_token(""));
+
+  Token step = synthetic_token("step");
+  if (Parser_check(parser, TOKEN_IDENTIFIER) && identifier_equals(&parser->current, &step)) {
+    Parser_advance(parser);
+    expression(parser);
+  } else {
+    emit_constant(parser, INT_VAL(1));
+  }
+  add_local(parser, synthetic_token(""));
+  compiler->locals[slot].name = name;
+
+  for (size_t i = slot; i < compiler->local_count; i++) {
+    compiler->locals[i].depth = compiler->scope_depth;
+  }
+
+  if (slot > UINT8_MAX) {
+    error(parser, "Too many local variables in function.");
+  }
+
+  emit_bytes(parser, OP_FOR_PREP, slot);
+  const size_t exit_jump = emit_jump_operand(parser);
+  const size_t body_start = current_chunk(parser)->count;
+
+  Parser_consume(parser, TOKEN_LEFT_BRACE, "Expect '{' after loop range.");
+  begin_scope(parser);
+  block(parser);
+  end_scope(parser);
+
+  emit_bytes(parser, OP_FOR_LOOP, slot);
+
+  size_t offset = current_chunk(parser)->count - body_start + 2;
+  if (offset > UINT16_MAX) {
+    error(parser, "Loop body too large");
+  }
+
+  emit_byte(parser, (offset >> 0) & 0xff);
+  emit_byte(parser, (offset >> 8) & 0xff);
+
+  patch_jump(parser, exit_jump);
+  end_scope(parser);
+}
+
 static void block(Parser* parser) {
   while (!Parser_check(parser, TOKEN_RIGHT_BRACE) && !Parser_check(parser, TOKEN_EOF)) {
     declaration(parser);
@@ -675,12 +1272,16 @@ static void statement(Parser* parser) {
     if_statement(parser);
   } else if (Parser_match(parser, TOKEN_WHILE)) {
     while_statement(parser);
+  } else if (Parser_match(parser, TOKEN_FOR)) {
+    for_statement(parser);
   } else if (Parser_match(parser, TOKEN_LEFT_BRACE)) {
     begin_scope(parser);
     block(parser);
     end_scope(parser);
   } else if (Parser_match(parser, TOKEN_RETURN)) {
     return_statement(parser);
+  } else if (Parser_match(parser, TOKEN_IMPORT)) {
+    import_statement(parser);
   } else {
     expression_statement(parser);
   }
@@ -689,6 +1290,10 @@ static void statement(Parser* parser) {
 static void declaration(Parser* parser) {
   if (Parser_match(parser, TOKEN_FN)) {
     fn_declaration(parser);
+  } else if (Parser_match(parser, TOKEN_INLINE)) {
+    inline_declaration(parser);
+  } else if (Parser_match(parser, TOKEN_CLASS)) {
+    class_declaration(parser);
   } else if (Parser_match(parser, TOKEN_LET)) {
     var_declaration(parser);
   } else {
@@ -706,19 +1311,22 @@ static void return_statement(Parser* parser) {
   if (Parser_match(parser, TOKEN_SEMICOLON)) {
     emit_return(parser);
   } else {
+    if (parser->current_compiler->type == TYPE_INITIALIZER) {
+      error(parser, "Can't return a value from an initializer.");
+    }
+
     expression(parser);
     Parser_consume(parser, TOKEN_SEMICOLON, "Expect ';' after return value.");
     emit_byte(parser, OP_RETURN);
   }
 }
 
-static void function(Parser* parser, FunctionType type) {
-  Compiler compiler;
-  Compiler_init(&compiler, parser, type);
+/**
+ * Compiles a parameter list and body into the current compiler's function.
+ */
+static void function_body(Parser* parser) {
   begin_scope(parser); 
 
-  size_t line = parser->current.line;
-
   Parser_consume(parser, TOKEN_LEFT_PAREN, "Expect '(' after function name.");
 
   if (!Parser_check(parser, TOKEN_RIGHT_PAREN)) {
@@ -737,14 +1345,104 @@ static void function(Parser* parser, FunctionType type) {
   Parser_consume(parser, TOKEN_RIGHT_PAREN, "Expect ')' after parameters.");
   Parser_consume(parser, TOKEN_LEFT_BRACE, "Expect '{' before function body.");
   block(parser);
+}
+
+/**
+ * Skims over a function's parameters and brace-balanced body without
+ * generating code and records the source span for compile_lazy().
+ *
+ * Only used for functions declared at the top level of a script. Those can
+ * only ever reference globals from the outside, so they have no upvalues and
+ * can be compiled later without the enclosing compiler state.
+ */
+static void lazy_function(Parser* parser) {
+  ObjectFunction* function = ObjectFunction_create();
+  function->name = ObjectString_copy(parser->previous.start, parser->previous.length);
+  function->lazy_line = parser->current.line;
+
+  const char* start = parser->current.start;
+
+  Parser_consume(parser, TOKEN_LEFT_PAREN, "Expect '(' after function name.");
+
+  if (!Parser_check(parser, TOKEN_RIGHT_PAREN)) {
+    do {
+      function->arity++;
+
+      if (function->arity > 255) {
+        error_at_current(parser, "Can't have more than 255 parameters.");
+      }
+
+      Parser_consume(parser, TOKEN_IDENTIFIER, "Expect parameter name.");
+    } while (Parser_match(parser, TOKEN_COMMA));
+  }
+
+  Parser_consume(parser, TOKEN_RIGHT_PAREN, "Expect ')' after parameters.");
+  Parser_consume(parser, TOKEN_LEFT_BRACE, "Expect '{' before function body.");
+
+  size_t depth = 1;
+  while (depth > 0 && !Parser_check(parser, TOKEN_EOF)) {
+    if (Parser_check(parser, TOKEN_LEFT_BRACE)) {
+      depth++;
+    } else if (Parser_check(parser, TOKEN_RIGHT_BRACE)) {
+      depth--;
+    }
+
+    Parser_advance(parser);
+  }
+
+  if (depth > 0) {
+    error_at_current(parser, "Expect '}' after block.");
+    return;
+  }
+
+  const char* end = parser->previous.start + parser->previous.length;
+  function->lazy_source = ObjectString_copy(start, end - start);
+
+  emit_bytes(parser, OP_CLOSURE, Chunk_add_constant(current_chunk(parser), OBJECT_VAL(function)));
+}
+
+static void import_statement(Parser* parser) {
+  Parser_consume(parser, TOKEN_STRING, "Expect module path after 'import'.");
+
+  ObjectString* path;
+  VM_get_intern_str(parser->vm, parser->previous.start + 1, parser->previous.length - 2, &path);
+  size_t constant = make_constant(parser, OBJECT_VAL(path));
+
+  Parser_consume(parser, TOKEN_SEMICOLON, "Expect ';' after module path.");
+  emit_addr_bytes(parser, OP_IMPORT, OP_IMPORT_LONG, constant);
+}
+
+static ObjectFunction* compile_function(Parser* parser, FunctionType type) {
+  Compiler* enclosing = parser->current_compiler;
+  Compiler compiler;
+  Compiler_init(&compiler, parser, type, NULL);
+  function_body(parser);
 
   ObjectFunction* function = end_compiler(parser);
   emit_bytes(parser, OP_CLOSURE, Chunk_add_constant(current_chunk(parser), OBJECT_VAL(function)));
 
   for (int i = 0; i < function->upvalue_count; i++) {
-    emit_byte(parser, compiler.upvalues[i].is_local ? 1 : 0);
-    emit_byte(parser, compiler.upvalues[i].index);
+    Upvalue* upvalue = &compiler.upvalues[i];
+    Local* local = &upvalue->owner->locals[upvalue->local];
+
+    add_capture_site(local, enclosing->function, current_chunk(parser)->count);
+    emit_byte(parser, upvalue->is_local ? CAPTURE_LOCAL : CAPTURE_UPVALUE);
+    emit_byte(parser, upvalue->index);
+  }
+
+  return function;
+}
+
+static void function(Parser* parser, FunctionType type) {
+  Compiler* enclosing = parser->current_compiler;
+
+  if (parser->vm->lazy_compile && type == TYPE_FUNCTION &&
+      enclosing->type == TYPE_SCRIPT && enclosing->scope_depth == 0) {
+    lazy_function(parser);
+    return;
   }
+
+  compile_function(parser, type);
 }
 
 static void fn_declaration(Parser* parser) {
@@ -754,6 +1452,111 @@ static void fn_declaration(Parser* parser) {
   define_variable(parser, global);
 }
 
+/**
+ * inline fn name(params) { return expression; }
+ *
+ * Declares a function whose binding can't be reassigned. If its body is
+ * small enough, calls which name it directly are replaced with the body
+ * (see inline_body()); otherwise it is an ordinary function.
+ */
+static void inline_declaration(Parser* parser) {
+  Parser_consume(parser, TOKEN_FN, "Expect 'fn' after 'inline'.");
+
+  size_t global = parse_variable(parser, "Expect function name.");
+  Token name = parser->previous;
+  mark_initialized(parser);
+
+  ObjectFunction* function = compile_function(parser, TYPE_FUNCTION);
+  define_variable(parser, global);
+
+  if (parser->had_error || !inline_body(parser, function, false)) return;
+
+  Compiler* compiler = parser->current_compiler;
+  if (compiler->scope_depth > 0) {
+    compiler->locals[compiler->local_count - 1].inline_function = function;
+    return;
+  }
+
+  if (parser->inline_global_capacity < parser->inline_global_count + 1) {
+    size_t old_capacity = parser->inline_global_capacity;
+    parser->inline_global_capacity = GROW_CAPACITY(old_capacity);
+    parser->inline_globals = GROW_ARRAY(InlineGlobal, parser->inline_globals,
+                                        old_capacity, parser->inline_global_capacity);
+  }
+
+  parser->inline_globals[parser->inline_global_count].name = name;
+  parser->inline_globals[parser->inline_global_count].function = function;
+  parser->inline_global_count++;
+}
+
+static void method(Parser* parser) {
+  Parser_consume(parser, TOKEN_FN, "Expect 'fn' before method.");
+  Parser_consume(parser, TOKEN_IDENTIFIER, "Expect method name.");
+  size_t name = identifier_constant(parser, parser->previous);
+
+  FunctionType type = TYPE_METHOD;
+  if (parser->previous.length == 4 && memcmp(parser->previous.start, "init", 4) == 0) {
+    type = TYPE_INITIALIZER;
+  }
+
+  function(parser, type);
+  emit_long_operand(parser, OP_METHOD, name);
+}
+
+/**
+ * class Name [< Superclass] { fn method(...) { ... } ... }
+ *
+ * Leaves the class on the stack while its methods are attached to it.
+ * Superclass methods are copied into the class up front, and the
+ * superclass is kept in a local named `super` which methods capture.
+ */
+static void class_declaration(Parser* parser) {
+  Parser_consume(parser, TOKEN_IDENTIFIER, "Expect class name.");
+  Token class_name = parser->previous;
+  size_t name = identifier_constant(parser, class_name);
+  declare_variable(parser);
+  if (parser->current_compiler->scope_depth == 0) forget_inline_global(parser, &class_name);
+
+  emit_long_operand(parser, OP_CLASS, name);
+  define_variable(parser, name);
+
+  ClassCompiler class_compiler;
+  class_compiler.has_superclass = false;
+  class_compiler.enclosing = parser->current_class;
+  parser->current_class = &class_compiler;
+
+  if (Parser_match(parser, TOKEN_LESS)) {
+    Parser_consume(parser, TOKEN_IDENTIFIER, "Expect superclass name.");
+    variable(parser, false);
+
+    if (identifier_equals(&class_name, &parser->previous)) {
+      error(parser, "A class can't inherit from itself.");
+    }
+
+    begin_scope(parser);
+    add_local(parser, synthetic_token("super"));
+    define_variable(parser, 0);
+
+    named_variable(parser, class_name, false);
+    emit_byte(parser, OP_INHERIT);
+    class_compiler.has_superclass = true;
+  }
+
+  named_variable(parser, class_name, false);
+  Parser_consume(parser, TOKEN_LEFT_BRACE, "Expect '{' before class body.");
+
+  while (!Parser_check(parser, TOKEN_RIGHT_BRACE) && !Parser_check(parser, TOKEN_EOF)) {
+    method(parser);
+  }
+
+  Parser_consume(parser, TOKEN_RIGHT_BRACE, "Expect '}' after class body.");
+  emit_byte(parser, OP_POP);
+
+  if (class_compiler.has_superclass) end_scope(parser);
+
+  parser->current_class = class_compiler.enclosing;
+}
+
 static void var_declaration(Parser* parser) {
   size_t global = parse_variable(parser, "Expect variable name.");
 
@@ -812,6 +1615,11 @@ static void add_local(Parser* parser, Token name) {
   local->name = name;
   local->depth = -1;
   local->is_captured = false;
+  local->is_assigned = false;
+  local->sites = NULL;
+  local->site_count = 0;
+  local->site_capacity = 0;
+  local->inline_function = NULL;
 }
 
 static void mark_initialized(Parser* parser) {
@@ -834,7 +1642,7 @@ void define_variable(Parser* parser, size_t global) {
 static size_t identifier_constant(Parser* parser, Token name) {
   ObjectString* str;
   VM_get_intern_str(parser->vm, name.start, name.length, &str);
-  return Chunk_add_constant(&parser->current_compiler->function->chunk, OBJECT_VAL(str));
+  return make_constant(parser, OBJECT_VAL(str));
 }
 
 static size_t parse_variable(Parser* parser, const char* err) {
@@ -843,24 +1651,27 @@ static size_t parse_variable(Parser* parser, const char* err) {
   declare_variable(parser);
   if (parser->current_compiler->scope_depth > 0) return 0;
 
+  forget_inline_global(parser, &parser->previous);
   return identifier_constant(parser, parser->previous);
 }
 
 static void Parser_synchronize(Parser* parser) {
   parser->panic_mode = false;
 
-  while (parser->current.type != EOF) {
+  while (parser->current.type != TOKEN_EOF) {
     if (parser->previous.type == TOKEN_SEMICOLON) return;
 
     switch (parser->current.type) {
       case TOKEN_CLASS:
       case TOKEN_FN:
+      case TOKEN_INLINE:
       case TOKEN_LET:
       case TOKEN_FOR:
       case TOKEN_IF:
       case TOKEN_WHILE:
       case TOKEN_PRINT:
       case TOKEN_RETURN:
+      case TOKEN_IMPORT:
         return;
 
       default: ;  // noop
@@ -870,30 +1681,49 @@ static void Parser_synchronize(Parser* parser) {
   }
 }
 
-void Compiler_init(Compiler* compiler, Parser* parser, FunctionType type) {
+/**
+ * Initializes a compiler emitting code into `function`. A new function is
+ * created if `function` is NULL.
+ */
+void Compiler_init(Compiler* compiler, Parser* parser, FunctionType type,
+                   ObjectFunction* function) {
   compiler->enclosing = parser->current_compiler;
   compiler->scope_depth = 0;
   compiler->function = NULL;
   compiler->type = type;
 
-  compiler->function = ObjectFunction_create();
+  compiler->function = function != NULL ? function : ObjectFunction_create();
 
   compiler->local_count = 1;
   compiler->local_capacity = 1;
   compiler->locals = ALLOCATE(Local, compiler->local_capacity);
 
+  compiler->constants = NULL;
+  compiler->constant_count = 0;
+  compiler->constant_capacity = 0;
+
   parser->current_compiler = compiler;
 
-  if (type != TYPE_SCRIPT) {
+  if (type != TYPE_SCRIPT && function == NULL) {
     compiler->function->name =
       ObjectString_copy(parser->previous.start, parser->previous.length);
   }
 
+  if (event_trace != NULL) {
+    ObjectString* name = compiler->function->name;
+    EventTrace_begin(event_trace, "compile", name != NULL ? name->chars : "script");
+  }
+
+  // slot 0 holds the receiver in methods, and the closure otherwise
   Local* local = &parser->current_compiler->locals[0];
   local->depth = 0;
-  local->name.start = "";
-  local->name.length = 0;
+  local->name = synthetic_token(type == TYPE_METHOD || type == TYPE_INITIALIZER ? "this" : "");
   local->is_captured = false;
+  local->is_assigned = false;
+  local->inline_function = NULL;
+  local->sites = NULL;
+  local->site_count = 0;
+  local->site_capacity = 0;
 }
 
 void Compiler_free(Compiler* compiler) {
@@ -902,6 +1732,11 @@ void Compiler_free(Compiler* compiler) {
   compiler->local_capacity = 0;
   compiler->locals = NULL;
   compiler->scope_depth = 0;
+
+  FREE_ARRAY(ConstantEntry, compiler->constants, compiler->constant_capacity);
+  compiler->constants = NULL;
+  compiler->constant_count = 0;
+  compiler->constant_capacity = 0;
 }
 
 ObjectFunction* compile(VM* vm, const char* source) {
@@ -915,10 +1750,14 @@ ObjectFunction* compile(VM* vm, const char* source) {
     .source = source,
     .vm = vm,
     .current_compiler = NULL,
+    .current_class = NULL,
+    .inline_globals = NULL,
+    .inline_global_count = 0,
+    .inline_global_capacity = 0,
   };
 
   Compiler compiler;
-  Compiler_init(&compiler, &parser, TYPE_SCRIPT);
+  Compiler_init(&compiler, &parser, TYPE_SCRIPT, NULL);
 
   Parser_advance(&parser);
 
@@ -927,7 +1766,49 @@ ObjectFunction* compile(VM* vm, const char* source) {
   }
 
   ObjectFunction* fn = end_compiler(&parser);
+  FREE_ARRAY(InlineGlobal, parser.inline_globals, parser.inline_global_capacity);
 
   return parser.had_error ? NULL : fn;
 }
 
+
+bool compile_lazy(VM* vm, ObjectFunction* function) {
+  ObjectString* source = function->lazy_source;
+
+  Scanner scanner;
+  Scanner_init(&scanner, source->chars);
+  scanner.line = function->lazy_line;
+
+  Parser parser = {
+    .scanner = &scanner,
+    .had_error = false,
+    .panic_mode = false,
+    .source = source->chars,
+    .vm = vm,
+    .current_compiler = NULL,
+    .current_class = NULL,
+    .inline_globals = NULL,
+    .inline_global_count = 0,
+    .inline_global_capacity = 0,
+  };
+
+  // Top level functions have no enclosing compiler; any name which is not
+  // resolved inside the body refers to a global.
+  Compiler compiler;
+  Compiler_init(&compiler, &parser, TYPE_FUNCTION, function);
+
+  function->arity = 0;
+  function->lazy_source = NULL;
+
+  Parser_advance(&parser);
+  function_body(&parser);
+  end_compiler(&parser);
+
+  if (parser.had_error) {
+    Chunk_free(&function->chunk);
+    function->lazy_source = source;
+    return false;
+  }
+
+  return true;
+}
@@ -5,5 +5,11 @@
 
 ObjectFunction* compile(VM* vm, const char* source);
 
+/**
+ * Compiles the deferred body of a function created in lazy mode.
+ * Returns false if the body failed to compile.
+ */
+bool compile_lazy(VM* vm, ObjectFunction* function);
+
 #endif // !peach_compiler_h
 
@@ -9,8 +9,81 @@ static size_t simple_instruction(const char* name, int offset);
 static size_t byte_instruction(const char* name, const Chunk* chunk, int offset);
 static size_t long_instruction(const char* name, const Chunk* chunk, int offset);
 static size_t jump_instruction(const char* name, const Chunk* chunk, int sign, int offset);
+static size_t for_instruction(const char* name, const Chunk* chunk, int sign, int offset);
 static size_t constant_instruction(const char* name, const Chunk* chunk, const size_t offset);
 static size_t constant_long_instruction(const char* name, const Chunk* chunk, const size_t offset);
+static size_t property_instruction(const char* name, const Chunk* chunk, const size_t offset);
+static size_t invoke_instruction(const char* name, const Chunk* chunk, const size_t offset);
+
+DebugFlags debug_flags = { false, false, false, false };
+
+static const char* opcode_names[] = {
+  [OP_LOAD_CONST]      = "OP_LOAD_CONST",
+  [OP_LOAD_CONST_LONG] = "OP_LOAD_CONST_LONG",
+  [OP_DEF_GLOBAL]      = "OP_DEF_GLOBAL",
+  [OP_DEF_GLOBAL_LONG] = "OP_DEF_GLOBAL_LONG",
+  [OP_GET_GLOBAL]      = "OP_GET_GLOBAL",
+  [OP_GET_GLOBAL_LONG] = "OP_GET_GLOBAL_LONG",
+  [OP_SET_GLOBAL]      = "OP_SET_GLOBAL",
+  [OP_SET_GLOBAL_LONG] = "OP_SET_GLOBAL_LONG",
+  [OP_GET_LOCAL]       = "OP_GET_LOCAL",
+  [OP_GET_LOCAL_LONG]  = "OP_GET_LOCAL_LONG",
+  [OP_SET_LOCAL]       = "OP_SET_LOCAL",
+  [OP_SET_LOCAL_LONG]  = "OP_SET_LOCAL_LONG",
+  [OP_GET_UPVALUE]     = "OP_GET_UPVALUE",
+  [OP_SET_UPVALUE]     = "OP_SET_UPVALUE",
+  [OP_NIL]             = "OP_NIL",
+  [OP_TRUE]            = "OP_TRUE",
+  [OP_FALSE]           = "OP_FALSE",
+  [OP_NEGATE]          = "OP_NEGATE",
+  [OP_EQUAL]           = "OP_EQUAL",
+  [OP_GREATER]         = "OP_GREATER",
+  [OP_LESS]            = "OP_LESS",
+  [OP_ADD]             = "OP_ADD",
+  [OP_SUB]             = "OP_SUB",
+  [OP_MUL]             = "OP_MUL",
+  [OP_DIV]             = "OP_DIV",
+  [OP_NOT]             = "OP_NOT",
+  [OP_INT_DIV]         = "OP_INT_DIV",
+  [OP_MOD]             = "OP_MOD",
+  [OP_BIT_AND]         = "OP_BIT_AND",
+  [OP_BIT_OR]          = "OP_BIT_OR",
+  [OP_BIT_XOR]         = "OP_BIT_XOR",
+  [OP_BIT_NOT]         = "OP_BIT_NOT",
+  [OP_SHIFT_LEFT]      = "OP_SHIFT_LEFT",
+  [OP_SHIFT_RIGHT]     = "OP_SHIFT_RIGHT",
+  [OP_POP]             = "OP_POP",
+  [OP_PEEK]            = "OP_PEEK",
+  [OP_POP_UNDER]       = "OP_POP_UNDER",
+  [OP_PRINT]           = "OP_PRINT",
+  [OP_RETURN]          = "OP_RETURN",
+  [OP_JUMP]            = "OP_JUMP",
+  [OP_JUMP_IF_FALSE]   = "OP_JUMP_IF_FALSE",
+  [OP_LOOP]            = "OP_LOOP",
+  [OP_FOR_PREP]        = "OP_FOR_PREP",
+  [OP_FOR_LOOP]        = "OP_FOR_LOOP",
+  [OP_CALL]            = "OP_CALL",
+  [OP_CLOSURE]         = "OP_CLOSURE",
+  [OP_CLOSE_UPVALUE]   = "OP_CLOSE_UPVALUE",
+  [OP_IMPORT]          = "OP_IMPORT",
+  [OP_IMPORT_LONG]     = "OP_IMPORT_LONG",
+  [OP_CLASS]           = "OP_CLASS",
+  [OP_INHERIT]         = "OP_INHERIT",
+  [OP_METHOD]          = "OP_METHOD",
+  [OP_GET_PROPERTY]    = "OP_GET_PROPERTY",
+  [OP_SET_PROPERTY]    = "OP_SET_PROPERTY",
+  [OP_INVOKE]          = "OP_INVOKE",
+  [OP_GET_SUPER]       = "OP_GET_SUPER",
+  [OP_SUPER_INVOKE]    = "OP_SUPER_INVOKE",
+};
+
+const char* opcode_name(uint8_t op) {
+  if (op >= sizeof(opcode_names) / sizeof(opcode_names[0]) || opcode_names[op] == NULL) {
+    return "OP_UNKNOWN";
+  }
+
+  return opcode_names[op];
+}
 
 void disassemble_chunk(Chunk *chunk, const char *name) {
   printf("== %s ==\n", name);
@@ -73,6 +146,10 @@ size_t disassemble_instruction(Chunk* chunk, size_t offset) {
       return jump_instruction("OP_JUMP", chunk, 1, offset);
     case OP_LOOP:
       return jump_instruction("OP_LOOP", chunk, -1, offset);
+    case OP_FOR_PREP:
+      return for_instruction("OP_FOR_PREP", chunk, 1, offset);
+    case OP_FOR_LOOP:
+      return for_instruction("OP_FOR_LOOP", chunk, -1, offset);
 
     case OP_NIL:
       return simple_instruction("OP_NIL", offset);
@@ -94,6 +171,30 @@ size_t disassemble_instruction(Chunk* chunk, size_t offset) {
       return simple_instruction("OP_RETURN", offset);
     case OP_NOT:
       return simple_instruction("OP_NOT", offset);
+
+    case OP_INT_DIV:
+      return simple_instruction("OP_INT_DIV", offset);
+
+    case OP_MOD:
+      return simple_instruction("OP_MOD", offset);
+
+    case OP_BIT_AND:
+      return simple_instruction("OP_BIT_AND", offset);
+
+    case OP_BIT_OR:
+      return simple_instruction("OP_BIT_OR", offset);
+
+    case OP_BIT_XOR:
+      return simple_instruction("OP_BIT_XOR", offset);
+
+    case OP_BIT_NOT:
+      return simple_instruction("OP_BIT_NOT", offset);
+
+    case OP_SHIFT_LEFT:
+      return simple_instruction("OP_SHIFT_LEFT", offset);
+
+    case OP_SHIFT_RIGHT:
+      return simple_instruction("OP_SHIFT_RIGHT", offset);
     case OP_EQUAL:
       return simple_instruction("OP_EQUAL", offset);
     case OP_GREATER:
@@ -104,6 +205,10 @@ size_t disassemble_instruction(Chunk* chunk, size_t offset) {
       return simple_instruction("OP_PRINT", offset);
     case OP_POP:
       return simple_instruction("OP_POP", offset);
+    case OP_PEEK:
+      return byte_instruction("OP_PEEK", chunk, offset);
+    case OP_POP_UNDER:
+      return byte_instruction("OP_POP_UNDER", chunk, offset);
     
     case OP_CALL:
       return byte_instruction("OP_CALL", chunk, offset);
@@ -116,12 +221,19 @@ size_t disassemble_instruction(Chunk* chunk, size_t offset) {
       printf("\n");
 
       ObjectFunction* function = AS_FUNCTION(chunk->constants.values[constant]);
+      static const char* kinds[] = {
+        [CAPTURE_UPVALUE] = "upvalue",
+        [CAPTURE_LOCAL] = "local",
+        [CAPTURE_LOCAL_VALUE] = "local value",
+        [CAPTURE_UPVALUE_VALUE] = "upvalue value",
+      };
+
       for (int j = 0; j < function->upvalue_count; j++) {
-        bool is_local = chunk->code[offset++];
-        bool index = chunk->code[offset++];
+        uint8_t kind = chunk->code[offset++];
+        uint8_t index = chunk->code[offset++];
         printf(
           "%04ld    |                     %s %d\n",
-          offset - 2, is_local ? "local" : "upvalue", index
+          offset - 2, kinds[kind], index
         );
       }
 
@@ -132,6 +244,28 @@ size_t disassemble_instruction(Chunk* chunk, size_t offset) {
       return simple_instruction("OP_CLOSE_UPVALUE", offset);
     }
 
+    case OP_IMPORT:
+      return constant_instruction("OP_IMPORT", chunk, offset);
+    case OP_IMPORT_LONG:
+      return constant_long_instruction("OP_IMPORT_LONG", chunk, offset);
+
+    case OP_CLASS:
+      return constant_long_instruction("OP_CLASS", chunk, offset);
+    case OP_INHERIT:
+      return simple_instruction("OP_INHERIT", offset);
+    case OP_METHOD:
+      return constant_long_instruction("OP_METHOD", chunk, offset);
+    case OP_GET_PROPERTY:
+      return property_instruction("OP_GET_PROPERTY", chunk, offset);
+    case OP_SET_PROPERTY:
+      return property_instruction("OP_SET_PROPERTY", chunk, offset);
+    case OP_INVOKE:
+      return invoke_instruction("OP_INVOKE", chunk, offset);
+    case OP_GET_SUPER:
+      return constant_long_instruction("OP_GET_SUPER", chunk, offset);
+    case OP_SUPER_INVOKE:
+      return invoke_instruction("OP_SUPER_INVOKE", chunk, offset);
+
     default:
       printf("Unknown opcode: %d\n", instruction);
       return offset + 1;
@@ -169,6 +303,15 @@ static size_t jump_instruction(const char* name, const Chunk* chunk,
   return offset + 3;
 }
 
+static size_t for_instruction(const char* name, const Chunk* chunk,
+                              int sign, int offset) {
+  uint8_t slot = chunk->code[offset + 1];
+  uint16_t jump = chunk->code[offset + 2] | (chunk->code[offset + 3] << 8);
+
+  printf("%-16s %4d %4u -> %u\n", name, slot, offset, offset + 4 + sign * jump);
+  return offset + 4;
+}
+
 static size_t constant_instruction(const char* name, const Chunk* chunk,
                                    const size_t offset) {
   uint8_t constant = chunk->code[offset + 1];
@@ -192,3 +335,35 @@ static size_t constant_long_instruction(const char* name, const Chunk* chunk, co
 
   return offset + 4;
 }
+
+static size_t property_instruction(const char* name, const Chunk* chunk, const size_t offset) {
+  const uint32_t constant =
+    chunk->code[offset + 1] | (chunk->code[offset + 2] << 8) | (chunk->code[offset + 3] << 16);
+  const uint16_t cache = chunk->code[offset + 4] | (chunk->code[offset + 5] << 8);
+
+  printf("%-16s %4u '", name, constant);
+  Value_print(chunk->constants.values[constant]);
+  printf("' cache %u\n", cache);
+
+  return offset + 6;
+}
+
+static size_t invoke_instruction(const char* name, const Chunk* chunk, const size_t offset) {
+  const uint32_t constant =
+    chunk->code[offset + 1] | (chunk->code[offset + 2] << 8) | (chunk->code[offset + 3] << 16);
+  const uint8_t arg_count = chunk->code[offset + 4];
+
+  printf("%-16s (%d args) %4u '", name, arg_count, constant);
+  Value_print(chunk->constants.values[constant]);
+
+  // super calls resolve statically and have no cache
+  if (chunk->code[offset] == OP_SUPER_INVOKE) {
+    printf("'\n");
+    return offset + 5;
+  }
+
+  const uint16_t cache = chunk->code[offset + 5] | (chunk->code[offset + 6] << 8);
+  printf("' cache %u\n", cache);
+
+  return offset + 7;
+}
@@ -4,9 +4,26 @@
 #include "common.h"
 #include "chunk.h"
 
+/**
+ * Debugging output and checks, selected on the command line.
+ */
+typedef struct {
+  bool print_code;       // --dump-bytecode: disassemble every compiled chunk
+  bool trace_execution;  // --trace: print the stack and each instruction
+  bool stress_gc;        // --gc-stress: collect on every allocation
+  bool log_gc;           // --gc-log: log allocations and collections
+} DebugFlags;
+
+extern DebugFlags debug_flags;
+
 void disassemble_chunk(Chunk* chunk, const char* name);
 
 size_t disassemble_instruction(Chunk* chunk, size_t offset);
 
+/**
+ * Returns the name of an opcode, as printed by the disassembler.
+ */
+const char* opcode_name(uint8_t op);
+
 #endif // !peach_debug_h
 
@@ -0,0 +1,119 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "event_trace.h"
+#include "tooling.h"
+#include "vm.h"
+
+EventTrace* event_trace = NULL;
+
+static void add_event(EventTrace* trace, char phase, const char* category,
+                             const char* name) {
+  if (trace->count == EVENT_TRACE_CAPACITY) {
+    trace->dropped++;
+    return;
+  }
+
+  TraceEvent* event = &trace->events[trace->count++];
+  event->name = name;
+  event->category = category;
+  event->timestamp_ns = now_ns();
+  event->phase = phase;
+}
+
+static const char* frame_name(CallFrame* frame) {
+  ObjectFunction* function = frame->closure->function;
+  return function->name != NULL ? function->name->chars : "script";
+}
+
+void EventTrace_start(EventTrace* trace, bool functions) {
+  trace->events = malloc(sizeof(TraceEvent) * EVENT_TRACE_CAPACITY);
+
+  if (trace->events == NULL) {
+    fprintf(stderr, "Not enough memory for the event trace.\n");
+    exit(74);
+  }
+
+  // touched up front, so page faults do not land in the middle of a trace
+  memset(trace->events, 0, sizeof(TraceEvent) * EVENT_TRACE_CAPACITY);
+
+  trace->count = 0;
+  trace->dropped = 0;
+  trace->start_ns = now_ns();
+  trace->functions = functions;
+  trace->frame_count = 0;
+
+  event_trace = trace;
+}
+
+void EventTrace_begin(EventTrace* trace, const char* category, const char* name) {
+  add_event(trace, 'B', category, name);
+}
+
+void EventTrace_end(EventTrace* trace, const char* category, const char* name) {
+  add_event(trace, 'E', category, name);
+}
+
+void EventTrace_sync_frames(EventTrace* trace, VM* vm) {
+  // returned frames keep their closure until another call reuses them
+  while (trace->frame_count > vm->frame_count) {
+    trace->frame_count--;
+    EventTrace_end(trace, "function", frame_name(&vm->frames[trace->frame_count]));
+  }
+
+  for (; trace->frame_count < vm->frame_count; trace->frame_count++) {
+    EventTrace_begin(trace, "function", frame_name(&vm->frames[trace->frame_count]));
+  }
+}
+
+void EventTrace_stop(EventTrace* trace, VM* vm) {
+  if (trace->functions) {
+    while (trace->frame_count > 0) {
+      trace->frame_count--;
+      EventTrace_end(trace, "function", frame_name(&vm->frames[trace->frame_count]));
+    }
+  }
+
+  if (event_trace == trace) event_trace = NULL;
+}
+
+bool EventTrace_write(EventTrace* trace, const char* path) {
+  FILE* file = fopen(path, "w");
+
+  if (file == NULL) {
+    fprintf(stderr, "Could not open file \"%s\"\n", path);
+    return false;
+  }
+
+  fprintf(file, "[\n");
+
+  for (size_t i = 0; i < trace->count; i++) {
+    TraceEvent* event = &trace->events[i];
+    uint64_t timestamp = event->timestamp_ns - trace->start_ns;
+
+    // timestamps are in microseconds
+    fprintf(file, "  {\"name\": ");
+    write_json_string(file, event->name);
+    fprintf(file, ", \"cat\": \"%s\", \"ph\": \"%c\", \"ts\": %llu.%03llu, \"pid\": 1, \"tid\": 1",
+            event->category, event->phase,
+            (unsigned long long) (timestamp / 1000), (unsigned long long) (timestamp % 1000));
+    fprintf(file, "}%s\n", i + 1 < trace->count ? "," : "");
+  }
+
+  fprintf(file, "]\n");
+  fclose(file);
+
+  if (trace->dropped > 0) {
+    fprintf(stderr, "event trace: dropped %zu events, the buffer was full.\n", trace->dropped);
+  }
+
+  return true;
+}
+
+void EventTrace_free(EventTrace* trace) {
+  if (event_trace == trace) event_trace = NULL;
+  free(trace->events);
+  trace->events = NULL;
+  trace->count = 0;
+}
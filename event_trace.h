@@ -0,0 +1,77 @@
+#ifndef peach_event_trace_h
+#define peach_event_trace_h
+
+#include "common.h"
+
+struct VM;
+
+// Capacity of the event buffer. Events past it are dropped and counted.
+#define EVENT_TRACE_CAPACITY (1 << 20)
+
+/**
+ * The start ('B') or end ('E') of a span. Names point to strings which
+ * outlive the trace: literals, or names of functions and natives, which
+ * are only freed with the VM.
+ */
+typedef struct {
+  const char* name;
+  const char* category;
+  uint64_t timestamp_ns;
+  char phase;
+} TraceEvent;
+
+/**
+ * A recorder of Chrome trace events, loadable in chrome://tracing and
+ * Perfetto. It records spans of compiling each function, of running and
+ * collecting, of native calls and, when `functions` is set, of every
+ * activation of a Peach function. Events go into a buffer allocated up
+ * front, so recording them neither allocates nor does any I/O.
+ */
+typedef struct {
+  TraceEvent* events;
+  size_t count;
+  size_t dropped;
+
+  uint64_t start_ns;
+
+  // Record a span for every call of a Peach function.
+  bool functions;
+
+  // Number of VM frames with an open span, when recording functions.
+  int frame_count;
+} EventTrace;
+
+/**
+ * The installed trace, NULL unless tracing events.
+ */
+extern EventTrace* event_trace;
+
+/**
+ * Allocates the buffer and installs `trace`.
+ */
+void EventTrace_start(EventTrace* trace, bool functions);
+
+void EventTrace_begin(EventTrace* trace, const char* category, const char* name);
+void EventTrace_end(EventTrace* trace, const char* category, const char* name);
+
+/**
+ * Ends the spans of frames which returned and begins those of frames
+ * which were pushed since the last call.
+ */
+void EventTrace_sync_frames(EventTrace* trace, struct VM* vm);
+
+/**
+ * Ends the spans still open, such as those of frames a runtime error
+ * unwound, and uninstalls `trace`.
+ */
+void EventTrace_stop(EventTrace* trace, struct VM* vm);
+
+/**
+ * Writes the events as a JSON array. Returns false if the file could not
+ * be written.
+ */
+bool EventTrace_write(EventTrace* trace, const char* path);
+
+void EventTrace_free(EventTrace* trace);
+
+#endif // !peach_event_trace_h
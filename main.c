@@ -4,12 +4,18 @@
 
 #include "common.h"
 #include "vm.h"
+#include "alloc_profiler.h"
+#include "call_profiler.h"
 #include "compiler.h"
+#include "debug.h"
+#include "event_trace.h"
+#include "profiler.h"
 
 static void repl(VM* vm) {
   char line[1024];
 
   for (;;) {
+    Output_flush(&vm->out);
     printf("> ");
 
     if (!fgets(line, sizeof(line), stdin)) {
@@ -52,29 +58,120 @@ static char* read_file(const char* path) {
   return buffer;
 }
 
-static void run_file(VM* vm, const char* path) {
+static InterpretResult run_file(VM* vm, const char* path) {
   char* source = read_file(path);
+  VM_enter_main(vm, path);
   InterpretResult result = VM_interpret(vm, source);
   free(source);
 
-  if (result == INTERPRET_COMPILE_ERROR) exit(65);
-  if (result == INTERPRET_RUNTIME_ERROR) exit(70);
+  return result;
 }
 
 int main(int argc, char *argv[]) {
   VM vm;
   VM_init(&vm);
 
-  if (argc == 1) {
+  bool stats = false;
+  const char* profile_path = NULL;
+  const char* call_profile_path = NULL;
+  bool profile_allocs = false;
+  const char* event_trace_path = NULL;
+  bool trace_functions = false;
+
+  int arg = 1;
+  for (; arg < argc && strncmp(argv[arg], "--", 2) == 0; arg++) {
+    if (strcmp(argv[arg], "--lazy") == 0) {
+      vm.lazy_compile = true;
+    } else if (strcmp(argv[arg], "--stats") == 0) {
+      stats = true;
+    } else if (strcmp(argv[arg], "--trace") == 0) {
+      debug_flags.trace_execution = true;
+    } else if (strcmp(argv[arg], "--dump-bytecode") == 0) {
+      debug_flags.print_code = true;
+    } else if (strcmp(argv[arg], "--gc-log") == 0) {
+      debug_flags.log_gc = true;
+    } else if (strcmp(argv[arg], "--gc-stress") == 0) {
+      debug_flags.stress_gc = true;
+    } else if (strcmp(argv[arg], "--profile") == 0 && arg + 1 < argc) {
+      profile_path = argv[++arg];
+    } else if (strcmp(argv[arg], "--trace-events") == 0 && arg + 1 < argc) {
+      event_trace_path = argv[++arg];
+    } else if (strcmp(argv[arg], "--trace-functions") == 0) {
+      trace_functions = true;
+    } else if (strcmp(argv[arg], "--profile-allocs") == 0) {
+      profile_allocs = true;
+    } else if (strcmp(argv[arg], "--profile-calls") == 0 && arg + 1 < argc) {
+      call_profile_path = argv[++arg];
+    } else {
+      break;
+    }
+  }
+
+  Profiler profiler;
+  if (profile_path != NULL) Profiler_start(&profiler, &vm);
+
+  CallProfiler call_profiler;
+  if (call_profile_path != NULL) {
+    CallProfiler_init(&call_profiler);
+    vm.call_profiler = &call_profiler;
+  }
+
+  AllocProfiler allocs;
+  if (profile_allocs) AllocProfiler_start(&allocs, &vm);
+
+  EventTrace trace;
+  if (event_trace_path != NULL) EventTrace_start(&trace, trace_functions);
+
+  InterpretResult result = INTERPRET_OK;
+
+  if (arg == argc) {
     repl(&vm);
-  } else if (argc == 2) {
-    run_file(&vm, argv[1]);
+  } else if (arg + 1 == argc) {
+    result = run_file(&vm, argv[arg]);
   } else {
-    fprintf(stderr, "Usage: peach [path]\n");
+    fprintf(stderr, "Usage: peach [--lazy] [--stats] [--profile out.folded]\n"
+                    "             [--profile-calls out.json] [--profile-allocs]\n"
+                    "             [--trace-events out.json [--trace-functions]] [--trace]\n"
+                    "             [--dump-bytecode] [--gc-log] [--gc-stress] [path]\n");
   }
 
+  if (profile_path != NULL) {
+    Profiler_stop(&profiler);
+    Profiler_write(&profiler, profile_path);
+    Profiler_free(&profiler);
+  }
+
+  if (call_profile_path != NULL) {
+    CallProfiler_stop(&call_profiler);
+    Output_flush(&vm.out);
+    CallProfiler_print(&call_profiler, stderr);
+    CallProfiler_write_json(&call_profiler, call_profile_path);
+    CallProfiler_free(&call_profiler);
+    vm.call_profiler = NULL;
+  }
+
+  if (event_trace_path != NULL) {
+    EventTrace_stop(&trace, &vm);
+    EventTrace_write(&trace, event_trace_path);
+    EventTrace_free(&trace);
+  }
+
+  if (profile_allocs) {
+    Output_flush(&vm.out);
+    AllocProfiler_print(&allocs, stderr);
+    AllocProfiler_free(&allocs);
+  }
+
+  if (stats) VM_print_stats(&vm);
+
+  #ifdef DEBUG_COUNT_OPCODES
+  VM_print_opcode_counts(&vm);
+  #endif
+
   VM_free(&vm);
 
+  if (result == INTERPRET_COMPILE_ERROR) return 65;
+  if (result == INTERPRET_RUNTIME_ERROR) return 70;
   return 0;
 }
 
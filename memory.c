@@ -1,15 +1,41 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
 
+#include "alloc_profiler.h"
+#include "debug.h"
+#include "event_trace.h"
 #include "memory.h"
 #include "object.h"
+#include "tooling.h"
 #include "vm.h"
 
+Heap* current_heap = NULL;
+
+void Heap_init(Heap* heap) {
+  heap->objects = NULL;
+  memset(&heap->stats, 0, sizeof(heap->stats));
+}
+
 void * reallocate(void* pointer, size_t old_size, size_t new_size) {
-  if (new_size > old_size) {
-    #ifdef DEBUG_STRESS_GC
-      gc();
-    #endif
+  if (new_size > old_size && debug_flags.stress_gc) {
+    gc();
+  }
+
+  if (current_heap != NULL) {
+    HeapStats* stats = &current_heap->stats;
+
+    // wraps around as intended when shrinking
+    stats->bytes_allocated += new_size - old_size;
+
+    if (new_size > old_size) {
+      stats->total_bytes_allocated += new_size - old_size;
+
+      if (stats->bytes_allocated > stats->peak_bytes_allocated) {
+        stats->peak_bytes_allocated = stats->bytes_allocated;
+      }
+    }
   }
 
   if (new_size == 0) {
@@ -37,9 +63,13 @@ void free_objects(Object *head) {
 }
 
 void free_object(Object* object) {
-  #ifdef DEBUG_LOG_GC
+  if (debug_flags.log_gc) {
     printf("%p free type %d\n", (void*) object, object->type);
-  #endif
+  }
+
+  if (alloc_profiler != NULL) AllocProfiler_release(alloc_profiler, object);
+
+  if (current_heap != NULL) current_heap->stats.objects[object->type]--;
 
   switch (object->type) {
     case OBJ_STRING: {
@@ -61,11 +91,52 @@ void free_object(Object* object) {
     case OBJ_CLOSURE: {
       ObjectClosure* closure = (ObjectClosure*) object;
       FREE_ARRAY(ObjectUpvalue*, closure->upvalues, closure->upvalue_count);
+      if (closure->cells != NULL) FREE_ARRAY(ObjectUpvalue, closure->cells, closure->upvalue_count);
       FREE(ObjectClosure, closure);
       break;
     }
     case OBJ_NATIVE_FN: {
-      FREE(ObjectFunction, object);
+      FREE(ObjectNativeFn, object);
+      break;
+    }
+    case OBJ_MODULE: {
+      FREE(ObjectModule, object);
+      break;
+    }
+    case OBJ_MAPPING: {
+      ObjectMapping* mapping = (ObjectMapping*) object;
+      if (mapping->length > 0) munmap((void*) mapping->chars, mapping->length);
+      FREE(ObjectMapping, object);
+      break;
+    }
+    case OBJ_SLICE: {
+      FREE(ObjectSlice, object);
+      break;
+    }
+    case OBJ_LINE_ITERATOR: {
+      FREE(ObjectLineIterator, object);
+      break;
+    }
+    case OBJ_SHAPE: {
+      ObjectShape* shape = (ObjectShape*) object;
+      Table_free(&shape->transitions);
+      FREE(ObjectShape, object);
+      break;
+    }
+    case OBJ_CLASS: {
+      ObjectClass* klass = (ObjectClass*) object;
+      Table_free(&klass->methods);
+      FREE(ObjectClass, object);
+      break;
+    }
+    case OBJ_INSTANCE: {
+      ObjectInstance* instance = (ObjectInstance*) object;
+      FREE_ARRAY(Value, instance->fields, instance->field_capacity);
+      FREE(ObjectInstance, object);
+      break;
+    }
+    case OBJ_BOUND_METHOD: {
+      FREE(ObjectBoundMethod, object);
       break;
     }
   }
@@ -75,14 +146,31 @@ static void mark_roots() {
 
 }
 
+static void record_pause(uint64_t pause_ns) {
+  uint64_t us = pause_ns / 1000;
+  size_t bucket = 0;
+
+  while (bucket < GC_PAUSE_BUCKETS - 1 && us >= ((uint64_t) 1 << bucket)) {
+    bucket++;
+  }
+
+  if (current_heap == NULL) return;
+
+  current_heap->stats.collections++;
+  current_heap->stats.total_pause_ns += pause_ns;
+  current_heap->stats.pauses[bucket]++;
+}
+
 void gc() {
-  #ifdef DEBUG_LOG_GC
-    printf("-- gc begin\n");
-  #endif
+  uint64_t start = now_ns();
+  if (debug_flags.log_gc) printf("-- gc begin\n");
+  if (event_trace != NULL) EventTrace_begin(event_trace, "gc", "gc");
 
+  if (event_trace != NULL) EventTrace_begin(event_trace, "gc", "mark");
   mark_roots();
+  if (event_trace != NULL) EventTrace_end(event_trace, "gc", "mark");
 
-  #ifdef DEBUG_LOG_GC
-    printf("-- gc end\n");
-  #endif
+  if (event_trace != NULL) EventTrace_end(event_trace, "gc", "gc");
+  if (debug_flags.log_gc) printf("-- gc end\n");
+  record_pause(now_ns() - start);
 }
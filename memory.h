@@ -4,11 +4,6 @@
 #include "common.h"
 #include "object.h"
 
-#ifdef DEBUG_LOG_GC
-#include <stdio.h>
-#include "debug.h"
-#endif
-
 #define ALLOCATE(type, count) \
   (type*) reallocate(NULL, 0, sizeof(type) * (count))
 
@@ -24,6 +19,54 @@
 #define FREE_ARRAY(type, pointer, count) \
   reallocate(pointer, sizeof(type) * (count), 0)
 
+// Buckets of the GC pause histogram. A pause of `us` microseconds lands in
+// the first bucket `i` with us < 2^i, or in the last one.
+#define GC_PAUSE_BUCKETS 16
+
+/**
+ * Heap usage and collector activity of one VM. reallocate(),
+ * Object_create() and free_object() keep the counts of the current heap up
+ * to date as they go; the intern table fields are only filled in by
+ * VM_heap_stats().
+ */
+typedef struct {
+  size_t bytes_allocated;
+  size_t peak_bytes_allocated;
+  uint64_t total_bytes_allocated;
+
+  // Objects of each ObjectType which were allocated and not freed yet.
+  // The collector does not sweep, so objects are only freed with their VM.
+  uint64_t objects[OBJ_TYPE_COUNT];
+
+  uint64_t collections;
+  uint64_t total_pause_ns;
+  uint64_t pauses[GC_PAUSE_BUCKETS];
+
+  size_t interned_strings;
+  size_t intern_capacity;
+  double intern_load_factor;
+} HeapStats;
+
+/**
+ * What a VM allocated.
+ */
+typedef struct {
+  // Every object of the VM, linked through `next`, freed by VM_free().
+  Object* objects;
+
+  HeapStats stats;
+} Heap;
+
+/**
+ * The heap allocations are charged to, that of the VM which runs. VM_init()
+ * makes the heap of the new VM current, and the embedding API enters the
+ * heap of the VM it is called with and restores the previous one when it
+ * returns. NULL while no VM is current.
+ */
+extern Heap* current_heap;
+
+void Heap_init(Heap* heap);
+
 void * reallocate(void* pointer, size_t old_size, size_t new_size);
 
 void free_objects(Object *head);
@@ -1,7 +1,13 @@
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include "alloc_profiler.h"
+#include "debug.h"
 #include "object.h"
 #include "memory.h"
 #include "value.h"
@@ -14,14 +20,43 @@
 static Object* Object_create(size_t size, ObjectType type) {
   Object* object = (Object*) reallocate(NULL, 0, size);
   object->type = type;
+  object->next = NULL;
 
-  #ifdef DEBUG_LOG_GC
+  if (current_heap != NULL) {
+    object->next = current_heap->objects;
+    current_heap->objects = object;
+    current_heap->stats.objects[type]++;
+  }
+
+  if (debug_flags.log_gc) {
     printf("%p allocate %zu for %d\n", (void*) object, size, type);
-  #endif
+  }
+
+  if (alloc_profiler != NULL) AllocProfiler_record(alloc_profiler, object, size);
 
   return object;
 }
 
+static const char* type_names[] = {
+  [OBJ_STRING]        = "string",
+  [OBJ_UPVALUE]       = "upvalue",
+  [OBJ_FUNCTION]      = "function",
+  [OBJ_CLOSURE]       = "closure",
+  [OBJ_NATIVE_FN]     = "native",
+  [OBJ_MODULE]        = "module",
+  [OBJ_MAPPING]       = "mapping",
+  [OBJ_SLICE]         = "slice",
+  [OBJ_LINE_ITERATOR] = "line_iterator",
+  [OBJ_SHAPE]         = "shape",
+  [OBJ_CLASS]         = "class",
+  [OBJ_INSTANCE]      = "instance",
+  [OBJ_BOUND_METHOD]  = "bound_method",
+};
+
+const char* ObjectType_name(ObjectType type) {
+  return type_names[type];
+}
+
 uint32_t string_hash(uint32_t start, const char* str, size_t length) {
   uint32_t hash = start;
 
@@ -54,6 +89,10 @@ ObjectString* ObjectString_take(char* chars, size_t length) {
   string->chars = chars;
   string->hash = string_hash(STRING_HASH_INIT, chars, length);
 
+  if (alloc_profiler != NULL) {
+    AllocProfiler_add_bytes(alloc_profiler, (Object*) string, length + 1);
+  }
+
   return string;
 }
 
@@ -79,7 +118,12 @@ ObjectFunction* ObjectFunction_create() {
   ObjectFunction* fn = ALLOCATE_OBJECT(ObjectFunction, OBJ_FUNCTION);
   fn->arity = 0;
   fn->name = NULL;
+  fn->upvalue_count = 0;
+  fn->lazy_source = NULL;
+  fn->lazy_line = 0;
   Chunk_init(&fn->chunk);
+  fn->shared_closure = NULL;
+  fn->instruction_count = 0;
   return fn;
 }
 
@@ -93,30 +137,255 @@ ObjectClosure* ObjectClosure_crate(ObjectFunction* function) {
   closure->function = function;
   closure->upvalues = upvalues;
   closure->upvalue_count = function->upvalue_count;
+  closure->cells = NULL;
   return closure;
 }
 
-ObjectFunction* ObjectNativeFn_create(NativeFn function) {
+ObjectClosure* ObjectFunction_shared_closure(ObjectFunction* function) {
+  if (function->shared_closure == NULL) {
+    function->shared_closure = ObjectClosure_crate(function);
+  }
+
+  return function->shared_closure;
+}
+
+void ObjectClosure_capture_value(ObjectClosure* closure, uint8_t index, Value value) {
+  if (closure->cells == NULL) {
+    closure->cells = ALLOCATE(ObjectUpvalue, closure->upvalue_count);
+  }
+
+  ObjectUpvalue* cell = &closure->cells[index];
+  cell->object.type = OBJ_UPVALUE;
+  cell->object.next = NULL;
+  cell->closed = value;
+  cell->location = &cell->closed;
+  cell->next = NULL;
+
+  closure->upvalues[index] = cell;
+}
+
+ObjectNativeFn* ObjectNativeFn_create(ObjectString* name, NativeFn function) {
   ObjectNativeFn* native_fn = ALLOCATE_OBJECT(ObjectNativeFn, OBJ_NATIVE_FN);
+  native_fn->name = name;
+  native_fn->data = NULL;
   native_fn->function = function;
+  return native_fn;
+}
+
+ObjectModule* ObjectModule_create(ObjectString* path) {
+  ObjectModule* module = ALLOCATE_OBJECT(ObjectModule, OBJ_MODULE);
+  module->path = path;
+  module->mtime.tv_sec = 0;
+  module->mtime.tv_nsec = 0;
+  module->function = NULL;
+  module->loading = false;
+  return module;
+}
+
+ObjectMapping* ObjectMapping_open(const char* path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return NULL;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    close(fd);
+    return NULL;
+  }
+
+  const char* chars = NULL;
+  size_t length = (size_t) st.st_size;
+
+  // mmap refuses empty mappings; an empty file is an empty string
+  if (length > 0) {
+    void* data = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (data == MAP_FAILED) {
+      close(fd);
+      return NULL;
+    }
+
+    madvise(data, length, MADV_SEQUENTIAL);
+    chars = data;
+  }
+
+  close(fd);
+
+  ObjectMapping* mapping = ALLOCATE_OBJECT(ObjectMapping, OBJ_MAPPING);
+  mapping->chars = chars;
+  mapping->length = length;
+  return mapping;
+}
+
+ObjectSlice* ObjectSlice_create(Object* parent, const char* chars, size_t length) {
+  ObjectSlice* slice = ALLOCATE_OBJECT(ObjectSlice, OBJ_SLICE);
+  slice->parent = parent;
+  slice->chars = chars;
+  slice->length = length;
+  return slice;
+}
+
+ObjectLineIterator* ObjectLineIterator_create(ObjectMapping* mapping) {
+  ObjectLineIterator* iterator = ALLOCATE_OBJECT(ObjectLineIterator, OBJ_LINE_ITERATOR);
+  iterator->mapping = mapping;
+  iterator->position = 0;
+  return iterator;
+}
+
+ObjectSlice* ObjectLineIterator_next(ObjectLineIterator* iterator) {
+  ObjectMapping* mapping = iterator->mapping;
+  if (iterator->position >= mapping->length) return NULL;
+
+  const char* start = mapping->chars + iterator->position;
+  size_t rest = mapping->length - iterator->position;
+  const char* newline = memchr(start, '\n', rest);
+  size_t length = newline != NULL ? (size_t) (newline - start) : rest;
+
+  iterator->position += newline != NULL ? length + 1 : length;
+  return ObjectSlice_create((Object*) mapping, start, length);
+}
+
+ObjectShape* ObjectShape_create(ObjectShape* parent, ObjectString* name) {
+  ObjectShape* shape = ALLOCATE_OBJECT(ObjectShape, OBJ_SHAPE);
+  shape->parent = parent;
+  shape->name = name;
+  shape->field_count = parent != NULL ? parent->field_count + 1 : 0;
+  Table_init(&shape->transitions);
+  return shape;
+}
+
+ObjectShape* ObjectShape_transition(ObjectShape* shape, ObjectString* name) {
+  Value child;
+  if (Table_get(&shape->transitions, name, &child)) return (ObjectShape*) AS_OBJECT(child);
+
+  ObjectShape* created = ObjectShape_create(shape, name);
+  Table_set(&shape->transitions, name, OBJECT_VAL(created));
+  return created;
+}
+
+int64_t ObjectShape_find(ObjectShape* shape, ObjectString* name) {
+  for (; shape->parent != NULL; shape = shape->parent) {
+    if (shape->name == name) return shape->field_count - 1;
+  }
+
+  return -1;
+}
+
+ObjectClass* ObjectClass_create(ObjectString* name) {
+  ObjectClass* klass = ALLOCATE_OBJECT(ObjectClass, OBJ_CLASS);
+  klass->name = name;
+  Table_init(&klass->methods);
+  klass->initializer = NULL;
+  klass->root = ObjectShape_create(NULL, NULL);
+  return klass;
+}
+
+ObjectInstance* ObjectInstance_create(ObjectClass* klass) {
+  ObjectInstance* instance = ALLOCATE_OBJECT(ObjectInstance, OBJ_INSTANCE);
+  instance->klass = klass;
+  instance->shape = klass->root;
+  instance->fields = NULL;
+  instance->field_capacity = 0;
+  return instance;
+}
+
+void ObjectInstance_reshape(ObjectInstance* instance, ObjectShape* shape) {
+  if (shape->field_count > instance->field_capacity) {
+    uint32_t old_capacity = instance->field_capacity;
+    instance->field_capacity = GROW_CAPACITY(old_capacity);
+    instance->fields = GROW_ARRAY(Value, instance->fields, old_capacity,
+                                  instance->field_capacity);
+  }
+
+  instance->shape = shape;
 }
 
-void print_function(ObjectFunction* fn) {
+ObjectBoundMethod* ObjectBoundMethod_create(Value receiver, ObjectClosure* method) {
+  ObjectBoundMethod* bound = ALLOCATE_OBJECT(ObjectBoundMethod, OBJ_BOUND_METHOD);
+  bound->receiver = receiver;
+  bound->method = method;
+  return bound;
+}
+
+bool Value_chars(Value value, const char** chars, size_t* length) {
+  if (!IS_OBJECT(value)) return false;
+
+  switch (OBJECT_TYPE(value)) {
+    case OBJ_STRING:
+      *chars = AS_STRING(value)->chars;
+      *length = AS_STRING(value)->length;
+      return true;
+
+    case OBJ_MAPPING:
+      *chars = AS_MAPPING(value)->chars;
+      *length = AS_MAPPING(value)->length;
+      return true;
+
+    case OBJ_SLICE:
+      *chars = AS_SLICE(value)->chars;
+      *length = AS_SLICE(value)->length;
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+static void write_function(Output* out, ObjectFunction* fn) {
   if (fn->name == NULL) {
-    printf("<script>");
+    Output_cstring(out, "<script>");
     return;
   }
 
-  printf("<fn %s>", fn->name->chars);
+  Output_cstring(out, "<fn ");
+  Output_write(out, fn->name->chars, fn->name->length);
+  Output_char(out, '>');
 }
 
-void Object_print(Value value) {
+void Object_write(Output* out, Value value) {
   switch (OBJECT_TYPE(value)) {
-    case OBJ_STRING: printf("%s", AS_CSTRING(value)); break;
-    case OBJ_UPVALUE: printf("upvalue"); break;
-    case OBJ_FUNCTION: print_function(AS_FUNCTION(value)); break;
-    case OBJ_CLOSURE: print_function(AS_CLOSURE(value)->function); break;
-    case OBJ_NATIVE_FN: printf("<native fn>"); break;
+    case OBJ_STRING:
+      Output_write(out, AS_STRING(value)->chars, AS_STRING(value)->length);
+      break;
+
+    case OBJ_UPVALUE: Output_cstring(out, "upvalue"); break;
+    case OBJ_FUNCTION: write_function(out, AS_FUNCTION(value)); break;
+    case OBJ_CLOSURE: write_function(out, AS_CLOSURE(value)->function); break;
+    case OBJ_NATIVE_FN: Output_cstring(out, "<native fn>"); break;
+
+    case OBJ_MODULE:
+      Output_cstring(out, "<module ");
+      Output_cstring(out, AS_MODULE(value)->path->chars);
+      Output_char(out, '>');
+      break;
+
+    case OBJ_MAPPING:
+      Output_write(out, AS_MAPPING(value)->chars, AS_MAPPING(value)->length);
+      break;
+
+    case OBJ_SLICE:
+      Output_write(out, AS_SLICE(value)->chars, AS_SLICE(value)->length);
+      break;
+
+    case OBJ_LINE_ITERATOR: Output_cstring(out, "<lines>"); break;
+    case OBJ_SHAPE: Output_cstring(out, "<shape>"); break;
+
+    case OBJ_CLASS:
+      Output_cstring(out, "<class ");
+      Output_write(out, AS_CLASS(value)->name->chars, AS_CLASS(value)->name->length);
+      Output_char(out, '>');
+      break;
+
+    case OBJ_INSTANCE: {
+      ObjectString* name = AS_INSTANCE(value)->klass->name;
+      Output_char(out, '<');
+      Output_write(out, name->chars, name->length);
+      Output_cstring(out, " instance>");
+      break;
+    }
+
+    case OBJ_BOUND_METHOD:
+      write_function(out, AS_BOUND_METHOD(value)->method->function);
+      break;
   }
 }
 
@@ -3,8 +3,11 @@
 
 #include "common.h"
 #include "chunk.h"
+#include "table.h"
 #include "value.h"
 
+#include <time.h>
+
 #define STRING_HASH_INIT 2166136261
 
 typedef enum {
@@ -13,8 +16,18 @@ typedef enum {
   OBJ_FUNCTION,
   OBJ_CLOSURE,
   OBJ_NATIVE_FN,
+  OBJ_MODULE,
+  OBJ_MAPPING,
+  OBJ_SLICE,
+  OBJ_LINE_ITERATOR,
+  OBJ_SHAPE,
+  OBJ_CLASS,
+  OBJ_INSTANCE,
+  OBJ_BOUND_METHOD,
 } ObjectType;
 
+#define OBJ_TYPE_COUNT (OBJ_BOUND_METHOD + 1)
+
 struct Object {
   ObjectType type;
   struct Object* next;
@@ -28,28 +41,142 @@ typedef struct ObjectUpvalue {
 } ObjectUpvalue;
 
 
-typedef struct {
+typedef struct ObjectFunction {
   Object object;
   size_t arity;
   Chunk chunk;
   ObjectString* name;
   uint8_t upvalue_count;
+
+  // Parameter list and body of a function whose compilation was deferred
+  // until its first call, or NULL once the chunk has been compiled.
+  ObjectString* lazy_source;
+  size_t lazy_line;
+
+  // The one closure shared by every evaluation of a function without
+  // upvalues, created when it is first needed.
+  struct ObjectClosure* shared_closure;
+
+  // Instructions executed in the function, only counted in builds with
+  // DEBUG_COUNT_OPCODES.
+  uint64_t instruction_count;
 } ObjectFunction;
 
-typedef struct {
+typedef struct ObjectClosure {
   Object object;
   ObjectFunction* function;
   ObjectUpvalue** upvalues;
   uint8_t upvalue_count;
+
+  // Closed cells holding the variables captured by value, one per
+  // upvalue; allocated by the first such capture.
+  ObjectUpvalue* cells;
 } ObjectClosure;
 
-typedef Value (*NativeFn) (size_t arg_count, Value* args);
+struct VM;
+
+typedef Value (*NativeFn) (struct VM* vm, size_t arg_count, Value* args);
 
 typedef struct {
   Object object;
+  ObjectString* name;
   NativeFn function;
+
+  // Passed along by natives which call into the host, NULL otherwise.
+  void* data;
 } ObjectNativeFn;
 
+/**
+ * A module loaded through `import`, cached by canonical path.
+ */
+typedef struct {
+  Object object;
+  ObjectString* path;
+  struct timespec mtime;
+  ObjectFunction* function;
+
+  // Set while the module's top-level code is running, to detect cycles.
+  bool loading;
+} ObjectModule;
+
+/**
+ * A file mapped read-only into memory. It reads like a string holding the
+ * file's contents.
+ */
+typedef struct {
+  Object object;
+  const char* chars;
+  size_t length;
+} ObjectMapping;
+
+/**
+ * A read-only view of part of another string-like object, which it keeps
+ * alive. The bytes are not copied.
+ */
+typedef struct {
+  Object object;
+  Object* parent;
+  const char* chars;
+  size_t length;
+} ObjectSlice;
+
+/**
+ * Walks the lines of a mapping, yielding each one as a slice of it.
+ */
+typedef struct {
+  Object object;
+  ObjectMapping* mapping;
+  size_t position;
+} ObjectLineIterator;
+
+/**
+ * The layout of an instance's fields: which field lives in which slot of
+ * its `fields` array. Instances which had the same fields added in the same
+ * order share one shape.
+ *
+ * Shapes form a tree per class. Adding a field moves an instance from its
+ * shape to the child reached through the field's name, creating the child
+ * the first time that transition is taken.
+ */
+typedef struct ObjectShape {
+  Object object;
+  struct ObjectShape* parent;
+
+  // The field this shape adds to its parent, stored in slot
+  // `field_count - 1`. NULL for the root.
+  ObjectString* name;
+  uint32_t field_count;
+
+  // Child shapes keyed by the name of the field they add.
+  Table transitions;
+} ObjectShape;
+
+typedef struct {
+  Object object;
+  ObjectString* name;
+  Table methods;
+
+  // The `init` method, if any, looked up once rather than on each call.
+  ObjectClosure* initializer;
+
+  // Shape of instances without fields.
+  ObjectShape* root;
+} ObjectClass;
+
+typedef struct {
+  Object object;
+  ObjectClass* klass;
+  ObjectShape* shape;
+  Value* fields;
+  uint32_t field_capacity;
+} ObjectInstance;
+
+typedef struct {
+  Object object;
+  Value receiver;
+  ObjectClosure* method;
+} ObjectBoundMethod;
+
 struct ObjectString {
   Object object;
   size_t length;
@@ -63,18 +190,44 @@ struct ObjectString {
 #define IS_CLOSURE(value) is_object_type(value, OBJ_CLOSURE)
 #define IS_NATIVE_FN(value) is_object_type(value, OBJ_NATIVE_FN)
 #define IS_STRING(value)   is_object_type(value, OBJ_STRING)
+#define IS_MODULE(value)   is_object_type(value, OBJ_MODULE)
+#define IS_MAPPING(value)  is_object_type(value, OBJ_MAPPING)
+#define IS_SLICE(value)    is_object_type(value, OBJ_SLICE)
+#define IS_LINE_ITERATOR(value) is_object_type(value, OBJ_LINE_ITERATOR)
+#define IS_CLASS(value)    is_object_type(value, OBJ_CLASS)
+#define IS_INSTANCE(value) is_object_type(value, OBJ_INSTANCE)
+#define IS_BOUND_METHOD(value) is_object_type(value, OBJ_BOUND_METHOD)
 
 #define AS_FUNCTION(value) ((ObjectFunction*) AS_OBJECT(value))
 #define AS_CLOSURE(value) ((ObjectClosure*) AS_OBJECT(value))
 #define AS_NATIVE_FN(value) (((ObjectNativeFn*) AS_OBJECT(value))->function)
+#define AS_NATIVE(value)    ((ObjectNativeFn*) AS_OBJECT(value))
 #define AS_STRING(value)   ((ObjectString*) AS_OBJECT(value))
 #define AS_CSTRING(value)  (((ObjectString*) AS_OBJECT(value))->chars)
+#define AS_MODULE(value)   ((ObjectModule*) AS_OBJECT(value))
+#define AS_MAPPING(value)  ((ObjectMapping*) AS_OBJECT(value))
+#define AS_SLICE(value)    ((ObjectSlice*) AS_OBJECT(value))
+#define AS_LINE_ITERATOR(value) ((ObjectLineIterator*) AS_OBJECT(value))
+#define AS_CLASS(value)    ((ObjectClass*) AS_OBJECT(value))
+#define AS_INSTANCE(value) ((ObjectInstance*) AS_OBJECT(value))
+#define AS_BOUND_METHOD(value) ((ObjectBoundMethod*) AS_OBJECT(value))
 
 static inline bool is_object_type(Value value, ObjectType type) {
   return IS_OBJECT(value) && AS_OBJECT(value)->type == type;
 }
 
-void Object_print(Value value);
+void Object_write(Output* out, Value value);
+
+/**
+ * Returns the name of an object type, usable as an identifier.
+ */
+const char* ObjectType_name(ObjectType type);
+
+/**
+ * Gets the bytes of a string, slice or mapping.
+ * Returns false if `value` is none of those.
+ */
+bool Value_chars(Value value, const char** chars, size_t* length);
 
 /**
  * Allocates an ObjectString Object and takes the ownership of the given C-string.
@@ -92,7 +245,63 @@ ObjectFunction* ObjectFunction_create();
 
 ObjectClosure* ObjectClosure_crate(ObjectFunction* function);
 
-ObjectFunction* ObjectNativeFn_create(NativeFn fn);
+/**
+ * Returns the closure shared by all evaluations of a function without
+ * upvalues. Closures over such a function differ in nothing but identity.
+ */
+ObjectClosure* ObjectFunction_shared_closure(ObjectFunction* function);
+
+/**
+ * Captures `value` by value as the closure's upvalue `index`.
+ */
+void ObjectClosure_capture_value(ObjectClosure* closure, uint8_t index, Value value);
+
+ObjectNativeFn* ObjectNativeFn_create(ObjectString* name, NativeFn fn);
+
+ObjectModule* ObjectModule_create(ObjectString* path);
+
+/**
+ * Maps the file at `path` into memory.
+ * Returns NULL if the file could not be opened or mapped.
+ */
+ObjectMapping* ObjectMapping_open(const char* path);
+
+ObjectSlice* ObjectSlice_create(Object* parent, const char* chars, size_t length);
+
+ObjectLineIterator* ObjectLineIterator_create(ObjectMapping* mapping);
+
+/**
+ * Returns the next line of the iterator's mapping without its newline, or
+ * NULL once every line has been read.
+ */
+ObjectSlice* ObjectLineIterator_next(ObjectLineIterator* iterator);
+
+ObjectShape* ObjectShape_create(ObjectShape* parent, ObjectString* name);
+
+/**
+ * Returns the shape reached from `shape` by adding the field `name`.
+ */
+ObjectShape* ObjectShape_transition(ObjectShape* shape, ObjectString* name);
+
+/**
+ * Returns the slot of the field `name` in instances of `shape`, or -1 if
+ * they have no such field. Names are interned, so this compares pointers
+ * along the path to the root rather than hashing.
+ */
+int64_t ObjectShape_find(ObjectShape* shape, ObjectString* name);
+
+ObjectClass* ObjectClass_create(ObjectString* name);
+
+ObjectInstance* ObjectInstance_create(ObjectClass* klass);
+
+/**
+ * Moves an instance to `shape`, one of the children of its current shape,
+ * growing its fields to match. The new field is left for the caller to
+ * store.
+ */
+void ObjectInstance_reshape(ObjectInstance* instance, ObjectShape* shape);
+
+ObjectBoundMethod* ObjectBoundMethod_create(Value receiver, ObjectClosure* method);
 
 uint32_t string_hash(uint32_t start, const char* str, size_t length);
 
@@ -0,0 +1,408 @@
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "output.h"
+
+void Output_init(Output* out, FILE* file) {
+  out->file = file;
+  out->length = 0;
+}
+
+void Output_write(Output* out, const char* chars, size_t length) {
+  if (out->length + length > OUTPUT_BUFFER_SIZE) {
+    Output_flush(out);
+
+    if (length > OUTPUT_BUFFER_SIZE) {
+      fwrite(chars, sizeof(char), length, out->file);
+      return;
+    }
+  }
+
+  memcpy(out->buffer + out->length, chars, length);
+  out->length += length;
+}
+
+void Output_char(Output* out, char c) {
+  if (out->length == OUTPUT_BUFFER_SIZE) Output_flush(out);
+  out->buffer[out->length++] = c;
+}
+
+void Output_cstring(Output* out, const char* chars) {
+  Output_write(out, chars, strlen(chars));
+}
+
+void Output_number(Output* out, double number) {
+  if (out->length + NUMBER_MAX_LENGTH > OUTPUT_BUFFER_SIZE) Output_flush(out);
+  out->length += format_number(number, out->buffer + out->length);
+}
+
+void Output_integer(Output* out, int64_t integer) {
+  char digits[20];
+  int count = 0;
+
+  // negate as unsigned so INT64_MIN does not overflow
+  uint64_t magnitude = integer < 0 ? -(uint64_t) integer : (uint64_t) integer;
+
+  do {
+    digits[count++] = (char) ('0' + magnitude % 10);
+    magnitude /= 10;
+  } while (magnitude != 0);
+
+  if (out->length + count + 1 > OUTPUT_BUFFER_SIZE) Output_flush(out);
+  if (integer < 0) out->buffer[out->length++] = '-';
+  while (count > 0) out->buffer[out->length++] = digits[--count];
+}
+
+void Output_flush(Output* out) {
+  if (out->length > 0) {
+    fwrite(out->buffer, sizeof(char), out->length, out->file);
+    out->length = 0;
+  }
+
+  fflush(out->file);
+}
+
+/*
+ * Shortest round-trip digits using Grisu2 (Loitsch, "Printing Floating-Point
+ * Numbers Quickly and Accurately with Integers"). A double is scaled by a
+ * cached power of ten into a 64-bit fixed point range, and digits are
+ * generated until the result is within the rounding interval of the input.
+ */
+
+typedef struct {
+  uint64_t f;
+  int e;
+} DiyFp;
+
+#define DP_SIGNIFICAND_MASK 0x000fffffffffffffull
+#define DP_EXPONENT_MASK    0x7ff0000000000000ull
+#define DP_HIDDEN_BIT       0x0010000000000000ull
+#define DP_EXPONENT_BIAS    (0x3ff + 52)
+
+static const struct {
+  uint64_t f;
+  int e;
+} cached_powers[] = {
+  // significand, binary exponent: 10^-348 * 10^(8 * i)
+  {0xfa8fd5a0081c0288ull, -1220},  // 1e-348
+  {0xbaaee17fa23ebf76ull, -1193},  // 1e-340
+  {0x8b16fb203055ac76ull, -1166},  // 1e-332
+  {0xcf42894a5dce35eaull, -1140},  // 1e-324
+  {0x9a6bb0aa55653b2dull, -1113},  // 1e-316
+  {0xe61acf033d1a45dfull, -1087},  // 1e-308
+  {0xab70fe17c79ac6caull, -1060},  // 1e-300
+  {0xff77b1fcbebcdc4full, -1034},  // 1e-292
+  {0xbe5691ef416bd60cull, -1007},  // 1e-284
+  {0x8dd01fad907ffc3cull,  -980},  // 1e-276
+  {0xd3515c2831559a83ull,  -954},  // 1e-268
+  {0x9d71ac8fada6c9b5ull,  -927},  // 1e-260
+  {0xea9c227723ee8bcbull,  -901},  // 1e-252
+  {0xaecc49914078536dull,  -874},  // 1e-244
+  {0x823c12795db6ce57ull,  -847},  // 1e-236
+  {0xc21094364dfb5637ull,  -821},  // 1e-228
+  {0x9096ea6f3848984full,  -794},  // 1e-220
+  {0xd77485cb25823ac7ull,  -768},  // 1e-212
+  {0xa086cfcd97bf97f4ull,  -741},  // 1e-204
+  {0xef340a98172aace5ull,  -715},  // 1e-196
+  {0xb23867fb2a35b28eull,  -688},  // 1e-188
+  {0x84c8d4dfd2c63f3bull,  -661},  // 1e-180
+  {0xc5dd44271ad3cdbaull,  -635},  // 1e-172
+  {0x936b9fcebb25c996ull,  -608},  // 1e-164
+  {0xdbac6c247d62a584ull,  -582},  // 1e-156
+  {0xa3ab66580d5fdaf6ull,  -555},  // 1e-148
+  {0xf3e2f893dec3f126ull,  -529},  // 1e-140
+  {0xb5b5ada8aaff80b8ull,  -502},  // 1e-132
+  {0x87625f056c7c4a8bull,  -475},  // 1e-124
+  {0xc9bcff6034c13053ull,  -449},  // 1e-116
+  {0x964e858c91ba2655ull,  -422},  // 1e-108
+  {0xdff9772470297ebdull,  -396},  // 1e-100
+  {0xa6dfbd9fb8e5b88full,  -369},  // 1e-92
+  {0xf8a95fcf88747d94ull,  -343},  // 1e-84
+  {0xb94470938fa89bcfull,  -316},  // 1e-76
+  {0x8a08f0f8bf0f156bull,  -289},  // 1e-68
+  {0xcdb02555653131b6ull,  -263},  // 1e-60
+  {0x993fe2c6d07b7facull,  -236},  // 1e-52
+  {0xe45c10c42a2b3b06ull,  -210},  // 1e-44
+  {0xaa242499697392d3ull,  -183},  // 1e-36
+  {0xfd87b5f28300ca0eull,  -157},  // 1e-28
+  {0xbce5086492111aebull,  -130},  // 1e-20
+  {0x8cbccc096f5088ccull,  -103},  // 1e-12
+  {0xd1b71758e219652cull,   -77},  // 1e-4
+  {0x9c40000000000000ull,   -50},  // 1e4
+  {0xe8d4a51000000000ull,   -24},  // 1e12
+  {0xad78ebc5ac620000ull,     3},  // 1e20
+  {0x813f3978f8940984ull,    30},  // 1e28
+  {0xc097ce7bc90715b3ull,    56},  // 1e36
+  {0x8f7e32ce7bea5c70ull,    83},  // 1e44
+  {0xd5d238a4abe98068ull,   109},  // 1e52
+  {0x9f4f2726179a2245ull,   136},  // 1e60
+  {0xed63a231d4c4fb27ull,   162},  // 1e68
+  {0xb0de65388cc8ada8ull,   189},  // 1e76
+  {0x83c7088e1aab65dbull,   216},  // 1e84
+  {0xc45d1df942711d9aull,   242},  // 1e92
+  {0x924d692ca61be758ull,   269},  // 1e100
+  {0xda01ee641a708deaull,   295},  // 1e108
+  {0xa26da3999aef774aull,   322},  // 1e116
+  {0xf209787bb47d6b85ull,   348},  // 1e124
+  {0xb454e4a179dd1877ull,   375},  // 1e132
+  {0x865b86925b9bc5c2ull,   402},  // 1e140
+  {0xc83553c5c8965d3dull,   428},  // 1e148
+  {0x952ab45cfa97a0b3ull,   455},  // 1e156
+  {0xde469fbd99a05fe3ull,   481},  // 1e164
+  {0xa59bc234db398c25ull,   508},  // 1e172
+  {0xf6c69a72a3989f5cull,   534},  // 1e180
+  {0xb7dcbf5354e9beceull,   561},  // 1e188
+  {0x88fcf317f22241e2ull,   588},  // 1e196
+  {0xcc20ce9bd35c78a5ull,   614},  // 1e204
+  {0x98165af37b2153dfull,   641},  // 1e212
+  {0xe2a0b5dc971f303aull,   667},  // 1e220
+  {0xa8d9d1535ce3b396ull,   694},  // 1e228
+  {0xfb9b7cd9a4a7443cull,   720},  // 1e236
+  {0xbb764c4ca7a44410ull,   747},  // 1e244
+  {0x8bab8eefb6409c1aull,   774},  // 1e252
+  {0xd01fef10a657842cull,   800},  // 1e260
+  {0x9b10a4e5e9913129ull,   827},  // 1e268
+  {0xe7109bfba19c0c9dull,   853},  // 1e276
+  {0xac2820d9623bf429ull,   880},  // 1e284
+  {0x80444b5e7aa7cf85ull,   907},  // 1e292
+  {0xbf21e44003acdd2dull,   933},  // 1e300
+  {0x8e679c2f5e44ff8full,   960},  // 1e308
+  {0xd433179d9c8cb841ull,   986},  // 1e316
+  {0x9e19db92b4e31ba9ull,  1013},  // 1e324
+  {0xeb96bf6ebadf77d9ull,  1039},  // 1e332
+  {0xaf87023b9bf0ee6bull,  1066},  // 1e340
+};
+
+static const uint32_t pow10_32[] = {
+  1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000,
+};
+
+static const uint64_t pow10_64[] = {
+  1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull,
+  100000000ull, 1000000000ull, 10000000000ull, 100000000000ull,
+  1000000000000ull, 10000000000000ull, 100000000000000ull,
+  1000000000000000ull, 10000000000000000ull, 100000000000000000ull,
+  1000000000000000000ull, 10000000000000000000ull,
+};
+
+static DiyFp DiyFp_of(double d) {
+  uint64_t bits;
+  memcpy(&bits, &d, sizeof(bits));
+
+  int biased_e = (int) ((bits & DP_EXPONENT_MASK) >> 52);
+  uint64_t significand = bits & DP_SIGNIFICAND_MASK;
+
+  if (biased_e != 0) {
+    return (DiyFp) {significand + DP_HIDDEN_BIT, biased_e - DP_EXPONENT_BIAS};
+  }
+
+  return (DiyFp) {significand, 1 - DP_EXPONENT_BIAS};
+}
+
+static DiyFp DiyFp_sub(DiyFp a, DiyFp b) {
+  return (DiyFp) {a.f - b.f, a.e};
+}
+
+static DiyFp DiyFp_mul(DiyFp a, DiyFp b) {
+  unsigned __int128 p = (unsigned __int128) a.f * b.f;
+  uint64_t h = (uint64_t) (p >> 64);
+  uint64_t l = (uint64_t) p;
+
+  // round to nearest
+  if (l & (1ull << 63)) h++;
+
+  return (DiyFp) {h, a.e + b.e + 64};
+}
+
+static DiyFp DiyFp_normalize(DiyFp x) {
+  int shift = __builtin_clzll(x.f);
+  return (DiyFp) {x.f << shift, x.e - shift};
+}
+
+/**
+ * The boundaries of the rounding interval of `v`, normalized to a common
+ * exponent.
+ */
+static void DiyFp_boundaries(DiyFp v, DiyFp* minus, DiyFp* plus) {
+  DiyFp p = DiyFp_normalize((DiyFp) {(v.f << 1) + 1, v.e - 1});
+  DiyFp m = v.f == DP_HIDDEN_BIT
+    ? (DiyFp) {(v.f << 2) - 1, v.e - 2}
+    : (DiyFp) {(v.f << 1) - 1, v.e - 1};
+
+  m.f <<= m.e - p.e;
+  m.e = p.e;
+
+  *minus = m;
+  *plus = p;
+}
+
+/**
+ * Finds a power of ten c = 10^-k such that multiplying a number with binary
+ * exponent `e` by it yields an exponent in the range digit generation
+ * expects.
+ */
+static DiyFp cached_power(int e, int* k) {
+  double dk = (-61 - e) * 0.30102999566398114 + 347;
+  int ik = (int) dk;
+  if (dk - ik > 0.0) ik++;
+
+  unsigned index = (unsigned) ((ik >> 3) + 1);
+  *k = -(-348 + (int) (index << 3));
+
+  return (DiyFp) {cached_powers[index].f, cached_powers[index].e};
+}
+
+static int count_digits(uint32_t n) {
+  int digits = 1;
+  while (digits < 10 && n >= pow10_32[digits]) digits++;
+  return digits;
+}
+
+static void grisu_round(char* buffer, int length, uint64_t delta, uint64_t rest,
+                        uint64_t ten_kappa, uint64_t wp_w) {
+  while (rest < wp_w && delta - rest >= ten_kappa &&
+         (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) {
+    buffer[length - 1]--;
+    rest += ten_kappa;
+  }
+}
+
+static int generate_digits(DiyFp w, DiyFp mp, uint64_t delta, char* buffer, int* k) {
+  DiyFp one = {1ull << -mp.e, mp.e};
+  DiyFp wp_w = DiyFp_sub(mp, w);
+  uint32_t p1 = (uint32_t) (mp.f >> -one.e);
+  uint64_t p2 = mp.f & (one.f - 1);
+  int kappa = count_digits(p1);
+  int length = 0;
+
+  while (kappa > 0) {
+    uint32_t d = p1 / pow10_32[kappa - 1];
+    p1 %= pow10_32[kappa - 1];
+
+    if (d != 0 || length != 0) buffer[length++] = (char) ('0' + d);
+    kappa--;
+
+    uint64_t rest = ((uint64_t) p1 << -one.e) + p2;
+    if (rest <= delta) {
+      *k += kappa;
+      grisu_round(buffer, length, delta, rest, (uint64_t) pow10_32[kappa] << -one.e, wp_w.f);
+      return length;
+    }
+  }
+
+  for (;;) {
+    p2 *= 10;
+    delta *= 10;
+
+    char d = (char) (p2 >> -one.e);
+    if (d != 0 || length != 0) buffer[length++] = (char) ('0' + d);
+
+    p2 &= one.f - 1;
+    kappa--;
+
+    if (p2 < delta) {
+      *k += kappa;
+      int index = -kappa;
+      grisu_round(buffer, length, delta, p2, one.f, wp_w.f * (index < 20 ? pow10_64[index] : 0));
+      return length;
+    }
+  }
+}
+
+/**
+ * Writes the digits of a positive, finite `value` into `buffer` and returns
+ * their count. The value is `buffer` * 10^`k`.
+ */
+static int grisu2(double value, char* buffer, int* k) {
+  DiyFp v = DiyFp_of(value);
+  DiyFp w_minus;
+  DiyFp w_plus;
+  DiyFp_boundaries(v, &w_minus, &w_plus);
+
+  DiyFp c_mk = cached_power(w_plus.e, k);
+  DiyFp w = DiyFp_mul(DiyFp_normalize(v), c_mk);
+  DiyFp wp = DiyFp_mul(w_plus, c_mk);
+  DiyFp wm = DiyFp_mul(w_minus, c_mk);
+
+  wm.f++;
+  wp.f--;
+
+  return generate_digits(w, wp, wp.f - wm.f, buffer, k);
+}
+
+static size_t write_exponent(int exponent, char* dest) {
+  size_t length = 0;
+  dest[length++] = 'e';
+  dest[length++] = exponent < 0 ? '-' : '+';
+  if (exponent < 0) exponent = -exponent;
+
+  if (exponent >= 100) dest[length++] = (char) ('0' + exponent / 100);
+  if (exponent >= 10) dest[length++] = (char) ('0' + exponent / 10 % 10);
+  dest[length++] = (char) ('0' + exponent % 10);
+
+  return length;
+}
+
+size_t format_number(double number, char* dest) {
+  size_t length = 0;
+
+  if (isnan(number)) {
+    memcpy(dest, "nan", 3);
+    return 3;
+  }
+
+  if (signbit(number)) {
+    dest[length++] = '-';
+    number = -number;
+  }
+
+  if (isinf(number)) {
+    memcpy(dest + length, "inf", 3);
+    return length + 3;
+  }
+
+  if (number == 0) {
+    dest[length++] = '0';
+    return length;
+  }
+
+  char digits[20];
+  int k;
+  int count = grisu2(number, digits, &k);
+
+  // position of the decimal point relative to the first digit
+  int point = count + k;
+
+  if (count <= point && point <= 21) {
+    memcpy(dest + length, digits, count);
+    length += count;
+    memset(dest + length, '0', point - count);
+    length += point - count;
+  } else if (0 < point && point <= 21) {
+    memcpy(dest + length, digits, point);
+    length += point;
+    dest[length++] = '.';
+    memcpy(dest + length, digits + point, count - point);
+    length += count - point;
+  } else if (-6 < point && point <= 0) {
+    dest[length++] = '0';
+    dest[length++] = '.';
+    memset(dest + length, '0', -point);
+    length += -point;
+    memcpy(dest + length, digits, count);
+    length += count;
+  } else {
+    dest[length++] = digits[0];
+
+    if (count > 1) {
+      dest[length++] = '.';
+      memcpy(dest + length, digits + 1, count - 1);
+      length += count - 1;
+    }
+
+    length += write_exponent(point - 1, dest + length);
+  }
+
+  return length;
+}
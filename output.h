@@ -0,0 +1,48 @@
+#ifndef peach_output_h
+#define peach_output_h
+
+#include <stdio.h>
+
+#include "common.h"
+
+#define OUTPUT_BUFFER_SIZE 8192
+
+// Longest text `format_number` produces, e.g. "-1.2345678901234567e-308".
+#define NUMBER_MAX_LENGTH 32
+
+/**
+ * A write buffer in front of a stdio stream. Text is collected until the
+ * buffer is full or `Output_flush` is called.
+ */
+typedef struct {
+  FILE* file;
+  size_t length;
+  char buffer[OUTPUT_BUFFER_SIZE];
+} Output;
+
+void Output_init(Output* out, FILE* file);
+
+void Output_write(Output* out, const char* chars, size_t length);
+
+void Output_char(Output* out, char c);
+
+void Output_cstring(Output* out, const char* chars);
+
+void Output_number(Output* out, double number);
+
+void Output_integer(Output* out, int64_t integer);
+
+void Output_flush(Output* out);
+
+/**
+ * Writes the shortest decimal representation of `number` which reads back
+ * as the same double into `dest`, which must have room for
+ * NUMBER_MAX_LENGTH characters. Returns the length of the text; it is not
+ * NUL terminated.
+ *
+ * Integers up to 1e21 are written in full, other magnitudes outside
+ * [1e-6, 1e21) in exponent notation such as "1.5e-7".
+ */
+size_t format_number(double number, char* dest);
+
+#endif // !peach_output_h
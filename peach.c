@@ -0,0 +1,286 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "compiler.h"
+#include "memory.h"
+#include "object.h"
+#include "peach.h"
+#include "table.h"
+#include "vm.h"
+
+/**
+ * What a native defined by the host calls, kept in the native's `data`.
+ */
+typedef struct NativeBinding {
+  PeachNativeFn function;
+  void* user_data;
+  struct NativeBinding* next;
+} NativeBinding;
+
+struct PeachFunction {
+  Value callee;
+  struct PeachFunction* next;
+};
+
+struct PeachVM {
+  // first, so natives can get back to the PeachVM from the VM they are
+  // given
+  VM vm;
+
+  NativeBinding* bindings;
+
+  // Resolved functions, which keep their callee reachable.
+  PeachFunction* functions;
+};
+
+/**
+ * Makes the heap of `host` current for an API call, which may come from a
+ * native of another VM. Returns the heap to make current again after it.
+ */
+static Heap* enter(PeachVM* host) {
+  Heap* previous = current_heap;
+  current_heap = &host->vm.heap;
+  return previous;
+}
+
+static PeachValue to_peach(Value value) {
+  switch (value.type) {
+    case VAL_NIL: return peach_nil();
+    case VAL_BOOL: return peach_bool(AS_BOOL(value));
+    case VAL_INT: return peach_int(AS_INT(value));
+    case VAL_NUMBER: return peach_number(AS_NUMBER(value));
+    case VAL_OBJECT: {
+      const char* chars;
+      size_t length;
+
+      if (Value_chars(value, &chars, &length)) return peach_string(chars, length);
+
+      PeachValue object = { PEACH_OBJECT, { .object = AS_OBJECT(value) } };
+      return object;
+    }
+  }
+
+  return peach_nil();
+}
+
+static Value from_peach(VM* vm, PeachValue value) {
+  switch (value.type) {
+    case PEACH_NIL: return NIL_VAL;
+    case PEACH_BOOL: return BOOL_VAL(value.as.boolean);
+    case PEACH_INT: return INT_VAL(value.as.integer);
+    case PEACH_NUMBER: return NUMBER_VAL(value.as.number);
+    case PEACH_STRING: {
+      ObjectString* string;
+      VM_get_intern_str(vm, value.as.string.chars, value.as.string.length, &string);
+      return OBJECT_VAL(string);
+    }
+    case PEACH_OBJECT: return OBJECT_VAL(value.as.object);
+  }
+
+  return NIL_VAL;
+}
+
+static PeachResult to_result(InterpretResult result) {
+  switch (result) {
+    case INTERPRET_OK: return PEACH_OK;
+    case INTERPRET_COMPILE_ERROR: return PEACH_COMPILE_ERROR;
+    case INTERPRET_RUNTIME_ERROR: return PEACH_RUNTIME_ERROR;
+  }
+
+  return PEACH_RUNTIME_ERROR;
+}
+
+static Value call_host(VM* vm, size_t arg_count, Value* args) {
+  // the native being called sits below its arguments
+  NativeBinding* binding = AS_NATIVE(args[-1])->data;
+  PeachValue converted[UINT8_COUNT];
+
+  for (size_t i = 0; i < arg_count; i++) {
+    converted[i] = to_peach(args[i]);
+  }
+
+  PeachValue result = binding->function((PeachVM*) vm, (int) arg_count, converted,
+                                        binding->user_data);
+  return from_peach(vm, result);
+}
+
+PeachVM* peach_new(void) {
+  PeachVM* host = malloc(sizeof(PeachVM));
+  if (host == NULL) return NULL;
+
+  Heap* previous = current_heap;
+  VM_init(&host->vm);
+  current_heap = previous;
+
+  host->bindings = NULL;
+  host->functions = NULL;
+  return host;
+}
+
+void peach_free(PeachVM* host) {
+  Heap* previous = enter(host);
+  VM_free(&host->vm);
+  current_heap = previous != &host->vm.heap ? previous : NULL;
+
+  NativeBinding* binding = host->bindings;
+  while (binding != NULL) {
+    NativeBinding* next = binding->next;
+    free(binding);
+    binding = next;
+  }
+
+  PeachFunction* function = host->functions;
+  while (function != NULL) {
+    PeachFunction* next = function->next;
+    free(function);
+    function = next;
+  }
+
+  free(host);
+}
+
+PeachResult peach_interpret(PeachVM* host, const char* source) {
+  Heap* previous = enter(host);
+  InterpretResult result = VM_interpret(&host->vm, source);
+  Output_flush(&host->vm.out);
+  current_heap = previous;
+
+  return to_result(result);
+}
+
+PeachScript* peach_compile(PeachVM* host, const char* source) {
+  Heap* previous = enter(host);
+  ObjectFunction* script = compile(&host->vm, source);
+  current_heap = previous;
+
+  return (PeachScript*) script;
+}
+
+PeachResult peach_run(PeachVM* host, PeachScript* script) {
+  Heap* previous = enter(host);
+  InterpretResult result = VM_run_function(&host->vm, (ObjectFunction*) script);
+  Output_flush(&host->vm.out);
+  current_heap = previous;
+
+  return to_result(result);
+}
+
+static PeachResult call(PeachVM* host, Value callee, int arg_count, const PeachValue* args,
+                        PeachValue* result) {
+  VM* vm = &host->vm;
+
+  if (arg_count < 0 || arg_count > UINT8_MAX) {
+    fprintf(stderr, "Can't pass %d arguments.\n", arg_count);
+    return PEACH_RUNTIME_ERROR;
+  }
+
+  Value converted[UINT8_COUNT];
+  for (int i = 0; i < arg_count; i++) {
+    converted[i] = from_peach(vm, args[i]);
+  }
+
+  Value returned;
+  InterpretResult status = VM_call(vm, callee, arg_count, converted, &returned);
+
+  // flushing costs a call into stdio even with nothing to write
+  if (vm->out.length > 0) Output_flush(&vm->out);
+
+  if (status == INTERPRET_OK && result != NULL) *result = to_peach(returned);
+  return to_result(status);
+}
+
+PeachResult peach_call(PeachVM* host, const char* name, int arg_count,
+                       const PeachValue* args, PeachValue* result) {
+  Heap* previous = enter(host);
+  ObjectString* key;
+  Value callee;
+  PeachResult status;
+
+  VM_get_intern_str(&host->vm, name, strlen(name), &key);
+
+  if (Table_get(&host->vm.globals, key, &callee)) {
+    status = call(host, callee, arg_count, args, result);
+  } else {
+    fprintf(stderr, "Undefined variable '%s'.\n", name);
+    status = PEACH_RUNTIME_ERROR;
+  }
+
+  current_heap = previous;
+  return status;
+}
+
+PeachFunction* peach_function(PeachVM* host, const char* name) {
+  Heap* previous = enter(host);
+  ObjectString* key;
+  Value callee;
+
+  VM_get_intern_str(&host->vm, name, strlen(name), &key);
+  bool found = Table_get(&host->vm.globals, key, &callee);
+  current_heap = previous;
+
+  if (!found) return NULL;
+
+  PeachFunction* function = malloc(sizeof(PeachFunction));
+  if (function == NULL) return NULL;
+
+  function->callee = callee;
+  function->next = host->functions;
+  host->functions = function;
+  return function;
+}
+
+PeachResult peach_invoke(PeachVM* host, PeachFunction* function, int arg_count,
+                         const PeachValue* args, PeachValue* result) {
+  Heap* previous = enter(host);
+
+  // Whatever an earlier run left behind is garbage now. A native which
+  // invokes a function runs it on top of the frames which called it.
+  if (host->vm.frame_count == 0) VM_reset_stack(&host->vm);
+
+  PeachResult status = call(host, function->callee, arg_count, args, result);
+  current_heap = previous;
+  return status;
+}
+
+void peach_define_native(PeachVM* host, const char* name, PeachNativeFn function,
+                         void* user_data) {
+  NativeBinding* binding = malloc(sizeof(NativeBinding));
+
+  if (binding == NULL) {
+    fprintf(stderr, "peach: out of memory.");
+    exit(74);
+  }
+
+  binding->function = function;
+  binding->user_data = user_data;
+  binding->next = host->bindings;
+  host->bindings = binding;
+
+  Heap* previous = enter(host);
+  ObjectNativeFn* native = VM_define_native(&host->vm, name, call_host);
+  native->data = binding;
+  current_heap = previous;
+}
+
+bool peach_get_global(PeachVM* host, const char* name, PeachValue* value) {
+  Heap* previous = enter(host);
+  ObjectString* key;
+  Value global;
+
+  VM_get_intern_str(&host->vm, name, strlen(name), &key);
+  bool found = Table_get(&host->vm.globals, key, &global);
+  current_heap = previous;
+
+  if (found) *value = to_peach(global);
+  return found;
+}
+
+void peach_set_global(PeachVM* host, const char* name, PeachValue value) {
+  Heap* previous = enter(host);
+  ObjectString* key;
+
+  VM_get_intern_str(&host->vm, name, strlen(name), &key);
+  Table_set(&host->vm.globals, key, from_peach(&host->vm, value));
+  current_heap = previous;
+}
@@ -0,0 +1,164 @@
+#ifndef peach_h
+#define peach_h
+
+/**
+ * The embedding API of libpeach.
+ *
+ * It is the only header a host includes. Every type the interpreter uses
+ * internally stays opaque behind it, so hosts keep working across
+ * releases with the same PEACH_API_VERSION.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define PEACH_API_VERSION 1
+
+#if defined(__GNUC__)
+#define PEACH_API __attribute__((visibility("default")))
+#else
+#define PEACH_API
+#endif
+
+typedef struct PeachVM PeachVM;
+
+/**
+ * A compiled script, owned by the VM which compiled it.
+ */
+typedef struct PeachScript PeachScript;
+
+/**
+ * A script function resolved once, to be invoked many times. Owned by the
+ * VM which resolved it.
+ */
+typedef struct PeachFunction PeachFunction;
+
+typedef enum {
+  PEACH_OK,
+  PEACH_COMPILE_ERROR,
+  PEACH_RUNTIME_ERROR,
+} PeachResult;
+
+typedef enum {
+  PEACH_NIL,
+  PEACH_BOOL,
+  PEACH_INT,
+  PEACH_NUMBER,
+  PEACH_STRING,
+  PEACH_OBJECT,
+} PeachType;
+
+/**
+ * A value passed between the host and scripts.
+ *
+ * Strings the VM hands out point into its memory and stay valid while the
+ * VM lives. They may be views into larger strings, so they are not always
+ * NUL-terminated. Strings the host passes in are copied.
+ *
+ * Any other object is handed out as an opaque pointer, which can be given
+ * back to the same VM.
+ */
+typedef struct {
+  PeachType type;
+  union {
+    bool boolean;
+    int64_t integer;
+    double number;
+    struct {
+      const char* chars;
+      size_t length;
+    } string;
+    void* object;
+  } as;
+} PeachValue;
+
+static inline PeachValue peach_nil(void) {
+  PeachValue value = { PEACH_NIL, { .integer = 0 } };
+  return value;
+}
+
+static inline PeachValue peach_bool(bool boolean) {
+  PeachValue value = { PEACH_BOOL, { .boolean = boolean } };
+  return value;
+}
+
+static inline PeachValue peach_int(int64_t integer) {
+  PeachValue value = { PEACH_INT, { .integer = integer } };
+  return value;
+}
+
+static inline PeachValue peach_number(double number) {
+  PeachValue value = { PEACH_NUMBER, { .number = number } };
+  return value;
+}
+
+static inline PeachValue peach_string(const char* chars, size_t length) {
+  PeachValue value = { PEACH_STRING, { .string = { chars, length } } };
+  return value;
+}
+
+/**
+ * A native function defined by the host. `user_data` is the pointer given
+ * to peach_define_native().
+ */
+typedef PeachValue (*PeachNativeFn)(PeachVM* vm, int arg_count, const PeachValue* args,
+                                    void* user_data);
+
+PEACH_API PeachVM* peach_new(void);
+PEACH_API void peach_free(PeachVM* vm);
+
+/**
+ * Compiles and runs a script.
+ */
+PEACH_API PeachResult peach_interpret(PeachVM* vm, const char* source);
+
+/**
+ * Compiles a script without running it. Returns NULL if it does not
+ * compile; the errors are written to stderr.
+ */
+PEACH_API PeachScript* peach_compile(PeachVM* vm, const char* source);
+
+/**
+ * Runs the top-level code of a compiled script. It can be run any number
+ * of times, and is not compiled again.
+ */
+PEACH_API PeachResult peach_run(PeachVM* vm, PeachScript* script);
+
+/**
+ * Calls the global function `name` with `arg_count` arguments. What it
+ * returns is stored in `result`, unless that is NULL.
+ */
+PEACH_API PeachResult peach_call(PeachVM* vm, const char* name, int arg_count,
+                                 const PeachValue* args, PeachValue* result);
+
+/**
+ * Resolves the global function `name`, so it can be invoked without
+ * looking it up again. Returns NULL if it is not defined.
+ */
+PEACH_API PeachFunction* peach_function(PeachVM* vm, const char* name);
+
+/**
+ * Calls a resolved function like peach_call(), but without scanning,
+ * compiling or touching the intern table, except to intern string
+ * arguments. Called from the host, it starts on a reset stack; called
+ * from a native, it runs on top of the script which called the native.
+ */
+PEACH_API PeachResult peach_invoke(PeachVM* vm, PeachFunction* function, int arg_count,
+                                   const PeachValue* args, PeachValue* result);
+
+/**
+ * Defines a global native function which calls `function` with
+ * `user_data`.
+ */
+PEACH_API void peach_define_native(PeachVM* vm, const char* name, PeachNativeFn function,
+                                   void* user_data);
+
+/**
+ * Reads a global into `value`. Returns false if it is not defined.
+ */
+PEACH_API bool peach_get_global(PeachVM* vm, const char* name, PeachValue* value);
+
+PEACH_API void peach_set_global(PeachVM* vm, const char* name, PeachValue value);
+
+#endif // !peach_h
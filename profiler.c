@@ -0,0 +1,246 @@
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "profiler.h"
+#include "table.h"
+#include "vm.h"
+
+// The profiler the SIGPROF handler samples into.
+static Profiler* active_profiler = NULL;
+
+static struct sigaction previous_action;
+
+static uint64_t hash_frames(const ProfileFrame* frames, int depth) {
+  uint64_t hash = 14695981039346656037u;
+
+  for (int i = 0; i < depth; i++) {
+    hash = (hash ^ (uintptr_t) frames[i].function) * 1099511628211u;
+    hash = (hash ^ (uintptr_t) frames[i].ip) * 1099511628211u;
+  }
+
+  // the low bits pick the slot, but the pointers are aligned
+  return hash ^ (hash >> 29);
+}
+
+/**
+ * Finds the slot of the stack `frames`, which is unused if it was not seen
+ * yet.
+ */
+static ProfileStack* find_stack(Profiler* profiler, const ProfileFrame* frames, int depth,
+                                uint64_t hash) {
+  size_t index = hash & (PROFILER_STACKS - 1);
+
+  for (;;) {
+    ProfileStack* stack = &profiler->stacks[index];
+
+    if (stack->count == 0) return stack;
+
+    if (stack->hash == hash && stack->depth == (uint32_t) depth &&
+        memcmp(&profiler->frames[stack->first], frames, sizeof(ProfileFrame) * depth) == 0) {
+      return stack;
+    }
+
+    index = (index + 1) & (PROFILER_STACKS - 1);
+  }
+}
+
+/**
+ * Counts a sample of the call stack. Runs in the signal handler,
+ * interrupting the VM at an arbitrary point, so it only reads the frames
+ * and never allocates. A frame being pushed at that moment may show a
+ * stale closure or ip, which only costs accuracy since functions are
+ * never freed while the profiler runs.
+ */
+static void sample(int signal) {
+  (void) signal;
+
+  Profiler* profiler = active_profiler;
+  if (profiler == NULL) return;
+
+  VM* vm = profiler->vm;
+  int depth = __atomic_load_n(&vm->frame_count, __ATOMIC_RELAXED);
+  if (depth <= 0 || depth > FRAMES_MAX) return;
+
+  ProfileFrame frames[FRAMES_MAX];
+
+  for (int i = 0; i < depth; i++) {
+    ObjectClosure* closure = vm->frames[i].closure;
+    frames[i].function = closure != NULL ? closure->function : NULL;
+    frames[i].ip = vm->frames[i].ip;
+  }
+
+  uint64_t hash = hash_frames(frames, depth);
+  ProfileStack* stack = find_stack(profiler, frames, depth, hash);
+
+  if (stack->count == 0) {
+    if (profiler->stack_count + 1 > PROFILER_STACKS * 3 / 4 ||
+        profiler->frame_count + depth > PROFILER_FRAMES) {
+      profiler->dropped++;
+      return;
+    }
+
+    memcpy(&profiler->frames[profiler->frame_count], frames, sizeof(ProfileFrame) * depth);
+    stack->hash = hash;
+    stack->first = (uint32_t) profiler->frame_count;
+    stack->depth = (uint32_t) depth;
+
+    profiler->frame_count += depth;
+    profiler->stack_count++;
+  }
+
+  stack->count++;
+  profiler->samples++;
+}
+
+static size_t frame_line(ProfileFrame* frame) {
+  ObjectFunction* function = frame->function;
+  Chunk* chunk = &function->chunk;
+
+  if (frame->ip <= chunk->code || frame->ip > chunk->code + chunk->count) return 0;
+
+  // ip is already past the instruction being executed
+  return Chunk_get_line(chunk, frame->ip - chunk->code - 1);
+}
+
+static void append(char** buffer, size_t* length, size_t* capacity, const char* text, size_t count) {
+  if (*length + count + 1 > *capacity) {
+    *capacity = (*length + count + 1) * 2;
+    *buffer = realloc(*buffer, *capacity);
+
+    if (*buffer == NULL) {
+      fprintf(stderr, "Not enough memory to fold profile samples.\n");
+      exit(74);
+    }
+  }
+
+  memcpy(*buffer + *length, text, count);
+  *length += count;
+}
+
+/**
+ * Folds the sampled stacks into `profiler->folded`. Stacks which only
+ * differ in the ips of a line are merged.
+ */
+static void fold(Profiler* profiler) {
+  char* folded = NULL;
+  size_t capacity = 0;
+
+  for (size_t i = 0; i < PROFILER_STACKS; i++) {
+    ProfileStack* stack = &profiler->stacks[i];
+    if (stack->count == 0) continue;
+
+    size_t length = 0;
+
+    for (uint32_t j = 0; j < stack->depth; j++) {
+      ProfileFrame* frame = &profiler->frames[stack->first + j];
+      if (frame->function == NULL) continue;
+
+      const char* name = frame->function->name != NULL ? frame->function->name->chars : "script";
+      char line[64];
+      int count = snprintf(line, sizeof(line), ":%zu", frame_line(frame));
+
+      if (length > 0) append(&folded, &length, &capacity, ";", 1);
+      append(&folded, &length, &capacity, name, strlen(name));
+      append(&folded, &length, &capacity, line, count);
+    }
+
+    if (length == 0) continue;
+
+    ObjectString* key;
+    VM_get_intern_str(profiler->vm, folded, length, &key);
+
+    Value samples = INT_VAL(0);
+    Table_get(&profiler->folded, key, &samples);
+    Table_set(&profiler->folded, key, INT_VAL(AS_INT(samples) + (int64_t) stack->count));
+  }
+
+  free(folded);
+}
+
+void Profiler_start(Profiler* profiler, VM* vm) {
+  profiler->vm = vm;
+  profiler->stack_count = 0;
+  profiler->frame_count = 0;
+  profiler->samples = 0;
+  profiler->dropped = 0;
+  Table_init(&profiler->folded);
+
+  // touched up front, so the handler does not page fault
+  profiler->stacks = malloc(sizeof(ProfileStack) * PROFILER_STACKS);
+  profiler->frames = malloc(sizeof(ProfileFrame) * PROFILER_FRAMES);
+
+  if (profiler->stacks == NULL || profiler->frames == NULL) {
+    fprintf(stderr, "Not enough memory for the profiler.\n");
+    exit(74);
+  }
+
+  memset(profiler->stacks, 0, sizeof(ProfileStack) * PROFILER_STACKS);
+  memset(profiler->frames, 0, sizeof(ProfileFrame) * PROFILER_FRAMES);
+
+  // frames which were never pushed must not hold garbage the handler
+  // could follow
+  for (int i = vm->frame_count; i < FRAMES_MAX; i++) {
+    vm->frames[i].closure = NULL;
+    vm->frames[i].ip = NULL;
+  }
+
+  active_profiler = profiler;
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = sample;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGPROF, &action, &previous_action);
+
+  struct itimerval timer = {
+    .it_interval = { .tv_sec = 0, .tv_usec = PROFILER_INTERVAL_US },
+    .it_value = { .tv_sec = 0, .tv_usec = PROFILER_INTERVAL_US },
+  };
+  setitimer(ITIMER_PROF, &timer, NULL);
+}
+
+void Profiler_stop(Profiler* profiler) {
+  struct itimerval timer;
+  memset(&timer, 0, sizeof(timer));
+  setitimer(ITIMER_PROF, &timer, NULL);
+  sigaction(SIGPROF, &previous_action, NULL);
+
+  active_profiler = NULL;
+  fold(profiler);
+
+  if (profiler->dropped > 0) {
+    fprintf(stderr, "profiler: dropped %zu samples, too many distinct stacks.\n",
+            profiler->dropped);
+  }
+}
+
+bool Profiler_write(Profiler* profiler, const char* path) {
+  FILE* file = fopen(path, "w");
+
+  if (file == NULL) {
+    fprintf(stderr, "Could not open file \"%s\"\n", path);
+    return false;
+  }
+
+  for (size_t i = 0; i < profiler->folded.capacity; i++) {
+    Entry* entry = &profiler->folded.entries[i];
+    if (entry->key == NULL) continue;
+
+    fprintf(file, "%s %lld\n", entry->key->chars, (long long) AS_INT(entry->value));
+  }
+
+  fclose(file);
+  return true;
+}
+
+void Profiler_free(Profiler* profiler) {
+  free(profiler->stacks);
+  free(profiler->frames);
+  profiler->stacks = NULL;
+  profiler->frames = NULL;
+  Table_free(&profiler->folded);
+}
@@ -0,0 +1,83 @@
+#ifndef peach_profiler_h
+#define peach_profiler_h
+
+#include "common.h"
+#include "object.h"
+#include "vm.h"
+
+// Sampling interval of the profiler's CPU time timer.
+#define PROFILER_INTERVAL_US 1000
+
+// Capacity of the table of distinct stacks seen by the profiler.
+#define PROFILER_STACKS (1 << 14)
+
+// Capacity of the buffer holding the frames of those stacks.
+#define PROFILER_FRAMES (1 << 18)
+
+/**
+ * One frame of a sampled stack.
+ */
+typedef struct {
+  ObjectFunction* function;
+  const uint8_t* ip;
+} ProfileFrame;
+
+/**
+ * A distinct stack and the number of samples which found it. Its frames
+ * are `depth` consecutive entries of the frame buffer from `first`, from
+ * the outermost to the innermost.
+ */
+typedef struct {
+  uint64_t hash;
+  uint32_t first;
+  uint32_t depth;
+  uint64_t count;
+} ProfileStack;
+
+/**
+ * A sampling profiler of the Peach call stack. While it runs, a SIGPROF
+ * timer snapshots `vm->frames`, so the dispatch loop runs unchanged.
+ *
+ * The signal handler can not allocate, so it counts samples in a table
+ * of distinct stacks allocated up front. A sample of a stack seen before
+ * only bumps its count, which lets a long run be profiled as a whole;
+ * samples are only dropped once more distinct stacks were seen than fit.
+ */
+typedef struct {
+  VM* vm;
+
+  ProfileStack* stacks;
+  size_t stack_count;
+
+  ProfileFrame* frames;
+  size_t frame_count;
+
+  size_t samples;
+  size_t dropped;
+
+  // Folded stacks, mapped to their counts, once the profiler stopped.
+  Table folded;
+} Profiler;
+
+/**
+ * Starts sampling `vm`. Only one profiler can run at a time.
+ */
+void Profiler_start(Profiler* profiler, VM* vm);
+
+/**
+ * Stops the timer and folds the samples.
+ */
+void Profiler_stop(Profiler* profiler);
+
+/**
+ * Writes the samples in the folded format read by flamegraph.pl: one line
+ * per distinct stack, with `;` separated `function:line` frames from the
+ * outermost to the innermost, followed by the number of samples.
+ *
+ * Returns false if the file could not be written.
+ */
+bool Profiler_write(Profiler* profiler, const char* path);
+
+void Profiler_free(Profiler* profiler);
+
+#endif // !peach_profiler_h
@@ -3,6 +3,10 @@
 #include <string.h>
 #include "common.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 static Token string(Scanner* scanner);
 
 static Token number(Scanner* scanner);
@@ -11,9 +15,6 @@ static Token identifier(Scanner* scanner);
 
 static TokenType identifier_type(Scanner* scanner);
 
-static TokenType check_keyword(Scanner* scanner, size_t start, size_t length,
-                               const char* rest, TokenType type);
-
 static bool is_alpha(char c);
 
 static bool is_digit(char c);
@@ -34,6 +35,16 @@ static char peek(Scanner* scanner);
 
 static char peek_next(Scanner* scanner);
 
+static const char* skip_identifier_chars(const char* p);
+
+static const char* skip_digits(const char* p);
+
+static const char* skip_blanks(const char* p, size_t* lines);
+
+static const char* skip_to_line_end(const char* p);
+
+static const char* skip_string_body(const char* p, size_t* lines);
+
 
 void Scanner_init(Scanner *scanner, const char* source) {
   scanner->current = source;
@@ -62,11 +73,20 @@ Token Scanner_scan_token(Scanner *scanner) {
     case '}': return make_token(scanner, TOKEN_RIGHT_BRACE);
     case ';': return make_token(scanner, TOKEN_SEMICOLON);
     case ',': return make_token(scanner, TOKEN_COMMA);
-    case '.': return make_token(scanner, TOKEN_DOT);
+    case '.':
+      return make_token(scanner, match(scanner, '.') ? TOKEN_DOT_DOT : TOKEN_DOT);
+
     case '-': return make_token(scanner, TOKEN_MINUS);
     case '+': return make_token(scanner, TOKEN_PLUS);
     case '/': return make_token(scanner, TOKEN_SLASH);
     case '*': return make_token(scanner, TOKEN_STAR);
+    case '%': return make_token(scanner, TOKEN_PERCENT);
+    case '&': return make_token(scanner, TOKEN_AMPERSAND);
+    case '|': return make_token(scanner, TOKEN_PIPE);
+    case '^': return make_token(scanner, TOKEN_CARET);
+
+    case '~':
+      return make_token(scanner, match(scanner, '/') ? TOKEN_TILDE_SLASH : TOKEN_TILDE);
 
     case '!':
       return make_token(scanner, match(scanner, '=') ? TOKEN_BANG_EQUAL : TOKEN_BANG);
@@ -75,9 +95,11 @@ Token Scanner_scan_token(Scanner *scanner) {
       return make_token(scanner, match(scanner, '=') ? TOKEN_EQUAL_EQUAL : TOKEN_EQUAL);
 
     case '<':
+      if (match(scanner, '<')) return make_token(scanner, TOKEN_LESS_LESS);
       return make_token(scanner, match(scanner, '=') ? TOKEN_LESS_EQUAL : TOKEN_LESS);
 
     case '>':
+      if (match(scanner, '>')) return make_token(scanner, TOKEN_GREATER_GREATER);
       return make_token(scanner, match(scanner, '=') ? TOKEN_GREATER_EQUAL : TOKEN_GREATER);
 
     case '"': return string(scanner);
@@ -87,10 +109,7 @@ Token Scanner_scan_token(Scanner *scanner) {
 }
 
 static Token string(Scanner* scanner) {
-  while (peek(scanner) != '"' && !is_at_end(scanner)) {
-    if (peek(scanner) == '\n') scanner->line++;
-    advance(scanner);
-  }
+  scanner->current = skip_string_body(scanner->current, &scanner->line);
 
   if (is_at_end(scanner)) return error_token(scanner, "Unterminated string.");
 
@@ -99,70 +118,70 @@ static Token string(Scanner* scanner) {
 }
 
 static Token identifier(Scanner* scanner) {
-  while (is_alpha(peek(scanner)) || is_digit(peek(scanner)))
-    advance(scanner);
+  scanner->current = skip_identifier_chars(scanner->current);
 
   return make_token(scanner, identifier_type(scanner));
 }
 
-static TokenType identifier_type(Scanner* scanner) {
-  switch (scanner->start[0]) {
-    case 'a': return check_keyword(scanner, 1, 2, "nd",   TOKEN_AND);
-    case 'c': return check_keyword(scanner, 1, 4, "lass", TOKEN_CLASS);
-    case 'e': return check_keyword(scanner, 1, 3, "lse",  TOKEN_ELSE);
-    case 'f': {
-      if (scanner->current - scanner->start > 1) {
-        switch (scanner->start[1]) {
-          case 'a': return check_keyword(scanner, 2, 3, "lse", TOKEN_FALSE);
-          case 'n': return check_keyword(scanner, 2, 0, "", TOKEN_FN);
-          case 'o': return check_keyword(scanner, 2, 1, "r",   TOKEN_FOR);
-        }
-      }
-
-      break;
-    }
-    case 'i': return check_keyword(scanner, 1, 1, "f",     TOKEN_IF);
-    case 'l': return check_keyword(scanner, 1, 2, "et",   TOKEN_LET);
-    case 'n': return check_keyword(scanner, 1, 2, "il",    TOKEN_NIL);
-    case 'o': return check_keyword(scanner, 1, 1, "r",     TOKEN_OR);
-    case 'p': return check_keyword(scanner, 1, 4, "rint",  TOKEN_PRINT);
-    case 'r': return check_keyword(scanner, 1, 5, "eturn", TOKEN_RETURN);
-    case 's': return check_keyword(scanner, 1, 4, "uper",  TOKEN_SUPER);
-    case 't': {
-      if (scanner->current - scanner->start > 1) {
-        switch (scanner->start[1]) {
-          case 'h': return check_keyword(scanner, 2, 2, "is", TOKEN_THIS);
-          case 'r': return check_keyword(scanner, 2, 2, "ue", TOKEN_TRUE);
-        }
-      }
-
-      break;
-    }
-    case 'w': return check_keyword(scanner, 1, 4, "hile", TOKEN_WHILE);
-  }
-
-  return TOKEN_IDENTIFIER;
-}
+typedef struct {
+  const char* name;
+  size_t length;
+  TokenType type;
+} Keyword;
+
+/**
+ * Perfect hash of the keywords: (length + 7 * first + 9 * last) % 32.
+ * Every keyword lands in a distinct slot, so a lookup is one hash and at most
+ * one memcmp.
+ */
+#define KEYWORD_HASH(start, length) \
+  (((length) + 7 * (uint8_t) (start)[0] + 9 * (uint8_t) (start)[(length) - 1]) & 31)
+
+#define KEYWORD_MAX_LENGTH 6
+
+static const Keyword keywords[32] = {
+  [2]  = {"return", 6, TOKEN_RETURN},
+  [5]  = {"class",  5, TOKEN_CLASS},
+  [9]  = {"print",  5, TOKEN_PRINT},
+  [10] = {"fn",     2, TOKEN_FN},
+  [11] = {"let",    3, TOKEN_LET},
+  [12] = {"super",  5, TOKEN_SUPER},
+  [13] = {"or",     2, TOKEN_OR},
+  [14] = {"and",    3, TOKEN_AND},
+  [15] = {"for",    3, TOKEN_FOR},
+  [17] = {"nil",    3, TOKEN_NIL},
+  [18] = {"inline", 6, TOKEN_INLINE},
+  [19] = {"while",  5, TOKEN_WHILE},
+  [20] = {"else",   4, TOKEN_ELSE},
+  [23] = {"if",     2, TOKEN_IF},
+  [25] = {"import", 6, TOKEN_IMPORT},
+  [27] = {"this",   4, TOKEN_THIS},
+  [28] = {"false",  5, TOKEN_FALSE},
+  [29] = {"true",   4, TOKEN_TRUE},
+  [31] = {"in",     2, TOKEN_IN},
+};
 
-static TokenType check_keyword(Scanner* scanner, size_t start, size_t length,
-                               const char* rest, TokenType type) {
+static TokenType identifier_type(Scanner* scanner) {
+  const size_t length = scanner->current - scanner->start;
+  if (length > KEYWORD_MAX_LENGTH) return TOKEN_IDENTIFIER;
 
-  const size_t actual_length = (scanner->current - scanner->start);
+  const Keyword* keyword = &keywords[KEYWORD_HASH(scanner->start, length)];
 
-  if (start + length == actual_length &&
-    memcmp(scanner->start + start, rest, length) == 0) {
-    return type;
+  if (keyword->length == length &&
+      memcmp(scanner->start, keyword->name, length) == 0) {
+    return keyword->type;
   }
 
   return TOKEN_IDENTIFIER;
 }
 
 static Token number(Scanner* scanner) {
-  while (is_digit(peek(scanner))) advance(scanner);
+  scanner->current = skip_digits(scanner->current);
 
-  if (peek(scanner) == '.') {
+  // a '.' not followed by a digit starts a range, as in `0..10`
+  if (peek(scanner) == '.' && is_digit(peek_next(scanner))) {
     advance(scanner);
-    while (is_digit(peek(scanner))) advance(scanner);
+    scanner->current = skip_digits(scanner->current);
   }
 
   return make_token(scanner, TOKEN_NUMBER);
@@ -225,30 +244,175 @@ static char peek_next(Scanner* scanner) {
 
 static void skip_whitespace(Scanner* scanner) {
   for (;;) {
-    char c = peek(scanner);
+    scanner->current = skip_blanks(scanner->current, &scanner->line);
+
+    if (peek(scanner) == '/' && peek_next(scanner) == '/') {
+      scanner->current = skip_to_line_end(scanner->current);
+    } else {
+      return;
+    }
+  }
+}
+
+/*
+ * Bulk character class scanning.
+ *
+ * Each skip_* function returns a pointer to the first character at or after
+ * `p` which does not belong to the class. The source is NUL terminated and the
+ * terminator never belongs to a class, so runs always stop at the end.
+ *
+ * With SSE2 the source is scanned 16 bytes at a time. Loads are 16-byte
+ * aligned so they never cross a page boundary, which makes it safe to read
+ * bytes before `p` and past the terminator within the same block.
+ */
+
+#ifdef __SSE2__
+
+// AddressSanitizer reports the bytes around the source read by those
+// aligned loads, so the functions doing them are not instrumented.
+#define UNSANITIZED_LOADS __attribute__((no_sanitize_address))
+
+typedef uint32_t (*ClassMask)(__m128i chunk);
+
+static inline __m128i in_range(__m128i chunk, char low, char high) {
+  return _mm_and_si128(
+    _mm_cmpgt_epi8(chunk, _mm_set1_epi8(low - 1)),
+    _mm_cmplt_epi8(chunk, _mm_set1_epi8(high + 1))
+  );
+}
+
+static inline uint32_t newline_mask(__m128i chunk) {
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('\n')));
+}
 
-    switch (c) {
+static inline uint32_t identifier_mask(__m128i chunk) {
+  __m128i match = _mm_or_si128(in_range(chunk, 'a', 'z'), in_range(chunk, 'A', 'Z'));
+  match = _mm_or_si128(match, in_range(chunk, '0', '9'));
+  match = _mm_or_si128(match, _mm_cmpeq_epi8(chunk, _mm_set1_epi8('_')));
+  return _mm_movemask_epi8(match);
+}
+
+static inline uint32_t digit_mask(__m128i chunk) {
+  return _mm_movemask_epi8(in_range(chunk, '0', '9'));
+}
+
+static inline uint32_t blank_mask(__m128i chunk) {
+  __m128i match = _mm_or_si128(
+    _mm_cmpeq_epi8(chunk, _mm_set1_epi8(' ')),
+    _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\t'))
+  );
+  match = _mm_or_si128(match, _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\r')));
+  match = _mm_or_si128(match, _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\n')));
+  return _mm_movemask_epi8(match);
+}
+
+static inline uint32_t comment_mask(__m128i chunk) {
+  __m128i stop = _mm_or_si128(
+    _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\n')),
+    _mm_cmpeq_epi8(chunk, _mm_setzero_si128())
+  );
+  return ~_mm_movemask_epi8(stop) & 0xffff;
+}
+
+static inline uint32_t string_body_mask(__m128i chunk) {
+  __m128i stop = _mm_or_si128(
+    _mm_cmpeq_epi8(chunk, _mm_set1_epi8('"')),
+    _mm_cmpeq_epi8(chunk, _mm_setzero_si128())
+  );
+  return ~_mm_movemask_epi8(stop) & 0xffff;
+}
+
+/**
+ * Skips the run of characters accepted by `accept`. If `lines` is not NULL,
+ * it is incremented by the number of newlines in the run.
+ */
+static inline __attribute__((always_inline)) UNSANITIZED_LOADS const char* span(const char* p, ClassMask accept, size_t* lines) {
+  const size_t offset = (uintptr_t) p & 15;
+  const char* block = p - offset;
+
+  // bytes of the first block which lie before `p`
+  uint32_t before = (1u << offset) - 1;
+
+  for (;;) {
+    const __m128i chunk = _mm_load_si128((const __m128i*) block);
+    const uint32_t stop = ~(accept(chunk) | before) & 0xffff;
+
+    if (lines != NULL) {
+      uint32_t taken = (stop == 0 ? 0xffff : (stop & -stop) - 1) & ~before;
+      *lines += __builtin_popcount(newline_mask(chunk) & taken);
+    }
+
+    if (stop != 0) return block + __builtin_ctz(stop);
+
+    block += 16;
+    before = 0;
+  }
+}
+
+static UNSANITIZED_LOADS const char* skip_identifier_chars(const char* p) {
+  return span(p, identifier_mask, NULL);
+}
+
+static UNSANITIZED_LOADS const char* skip_digits(const char* p) {
+  return span(p, digit_mask, NULL);
+}
+
+static UNSANITIZED_LOADS const char* skip_blanks(const char* p, size_t* lines) {
+  // most tokens are separated by a single space or none at all
+  if (*p != ' ' && *p != '\n' && *p != '\t' && *p != '\r') return p;
+  if (p[1] != ' ' && p[1] != '\n' && p[1] != '\t' && p[1] != '\r') {
+    if (*p == '\n') (*lines)++;
+    return p + 1;
+  }
+
+  return span(p, blank_mask, lines);
+}
+
+static UNSANITIZED_LOADS const char* skip_to_line_end(const char* p) {
+  return span(p, comment_mask, NULL);
+}
+
+static UNSANITIZED_LOADS const char* skip_string_body(const char* p, size_t* lines) {
+  return span(p, string_body_mask, lines);
+}
+
+#else
+
+static const char* skip_identifier_chars(const char* p) {
+  while (is_alpha(*p) || is_digit(*p)) p++;
+  return p;
+}
+
+static const char* skip_digits(const char* p) {
+  while (is_digit(*p)) p++;
+  return p;
+}
+
+static const char* skip_blanks(const char* p, size_t* lines) {
+  for (;; p++) {
+    switch (*p) {
+      case '\n': (*lines)++; break;
       case ' ':
       case '\r':
       case '\t':
-        advance(scanner);
-        break;
-
-      case '\n':
-        advance(scanner);
-        scanner->line++;
         break;
 
-      case '/':
-        if (peek_next(scanner) == '/') {
-          while (peek(scanner) != '\n' && !is_at_end(scanner)) advance(scanner);
-        } else {
-          return;
-        }
-        break;
-      
-      default: return;
+      default: return p;
     }
   }
 }
 
+static const char* skip_to_line_end(const char* p) {
+  while (*p != '\n' && *p != '\0') p++;
+  return p;
+}
+
+static const char* skip_string_body(const char* p, size_t* lines) {
+  while (*p != '"' && *p != '\0') {
+    if (*p == '\n') (*lines)++;
+    p++;
+  }
+  return p;
+}
+
+#endif /* ifdef __SSE2__ */
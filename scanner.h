@@ -6,15 +6,18 @@
 typedef enum {
   TOKEN_LEFT_PAREN, TOKEN_RIGHT_PAREN,
   TOKEN_LEFT_BRACE, TOKEN_RIGHT_BRACE,
-  TOKEN_COMMA, TOKEN_DOT, TOKEN_MINUS, TOKEN_PLUS,
-  TOKEN_SEMICOLON, TOKEN_SLASH, TOKEN_STAR,
+  TOKEN_COMMA, TOKEN_DOT, TOKEN_DOT_DOT, TOKEN_MINUS, TOKEN_PLUS,
+  TOKEN_SEMICOLON, TOKEN_SLASH, TOKEN_STAR, TOKEN_PERCENT,
+  TOKEN_AMPERSAND, TOKEN_PIPE, TOKEN_CARET,
+  TOKEN_TILDE, TOKEN_TILDE_SLASH,
   TOKEN_BANG, TOKEN_BANG_EQUAL,
   TOKEN_EQUAL, TOKEN_EQUAL_EQUAL,
-  TOKEN_GREATER, TOKEN_GREATER_EQUAL,
-  TOKEN_LESS, TOKEN_LESS_EQUAL,
+  TOKEN_GREATER, TOKEN_GREATER_EQUAL, TOKEN_GREATER_GREATER,
+  TOKEN_LESS, TOKEN_LESS_EQUAL, TOKEN_LESS_LESS,
   TOKEN_IDENTIFIER, TOKEN_STRING, TOKEN_NUMBER,
   TOKEN_AND, TOKEN_CLASS, TOKEN_ELSE, TOKEN_FALSE,
-  TOKEN_FOR, TOKEN_FN, TOKEN_IF, TOKEN_NIL, TOKEN_OR,
+  TOKEN_FOR, TOKEN_FN, TOKEN_IF, TOKEN_IMPORT, TOKEN_IN, TOKEN_INLINE,
+  TOKEN_NIL, TOKEN_OR,
   TOKEN_PRINT, TOKEN_RETURN, TOKEN_SUPER, TOKEN_THIS,
   TOKEN_TRUE, TOKEN_LET, TOKEN_WHILE,
 
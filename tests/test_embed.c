@@ -0,0 +1,262 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../peach.h"
+
+// Checks made through the embedding API, run by `ctest` as `embed`.
+
+static int failures = 0;
+
+#define CHECK(condition) \
+  do { \
+    if (!(condition)) { \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+      failures++; \
+    } \
+  } while (false)
+
+static const char* script =
+  "let runs = 0;\n"
+  "fn add(a, b) { return a + b; }\n"
+  "fn twice(x) { return x * 2; }\n"
+  "fn bad() { return nil + 1; }\n"
+  "fn outer(x) {\n"
+  "  let before = 1;\n"
+  "  return before + callback(x);\n"
+  "}\n"
+  "fn recover() {\n"
+  "  let before = 10;\n"
+  "  return before + call_bad();\n"
+  "}\n";
+
+static PeachValue host_add(PeachVM* vm, int arg_count, const PeachValue* args,
+                           void* user_data) {
+  (void) vm;
+
+  int* calls = user_data;
+  (*calls)++;
+
+  if (arg_count != 2 || args[0].type != PEACH_INT || args[1].type != PEACH_INT) {
+    return peach_nil();
+  }
+
+  return peach_int(args[0].as.integer + args[1].as.integer);
+}
+
+// Calls back into the script which called it.
+static PeachValue callback(PeachVM* vm, int arg_count, const PeachValue* args,
+                           void* user_data) {
+  (void) user_data;
+
+  PeachValue result;
+  if (peach_call(vm, "twice", arg_count, args, &result) != PEACH_OK) return peach_nil();
+  return result;
+}
+
+// Invokes the resolved function given as user data from within the
+// script.
+static PeachValue invoke(PeachVM* vm, int arg_count, const PeachValue* args,
+                         void* user_data) {
+  PeachValue result;
+  if (peach_invoke(vm, user_data, arg_count, args, &result) != PEACH_OK) return peach_nil();
+  return result;
+}
+
+// Calls a function which fails, from within the script.
+static PeachValue call_bad(PeachVM* vm, int arg_count, const PeachValue* args,
+                           void* user_data) {
+  (void) arg_count;
+  (void) args;
+  (void) user_data;
+
+  PeachValue result;
+  if (peach_call(vm, "bad", 0, NULL, &result) != PEACH_RUNTIME_ERROR) return peach_nil();
+  return peach_int(-1);
+}
+
+// Runs the script given as user data from within the script.
+static PeachValue run_script(PeachVM* vm, int arg_count, const PeachValue* args,
+                             void* user_data) {
+  (void) arg_count;
+  (void) args;
+
+  if (peach_run(vm, user_data) != PEACH_RUNTIME_ERROR) return peach_nil();
+  return peach_int(-1);
+}
+
+static bool is_int(PeachValue value, int64_t integer) {
+  return value.type == PEACH_INT && value.as.integer == integer;
+}
+
+static bool is_string(PeachValue value, const char* chars) {
+  return value.type == PEACH_STRING && value.as.string.length == strlen(chars) &&
+         memcmp(value.as.string.chars, chars, value.as.string.length) == 0;
+}
+
+static void test_compile_and_run(PeachVM* vm) {
+  CHECK(peach_compile(vm, "let = ;") == NULL);
+  CHECK(peach_interpret(vm, "fn f( {") == PEACH_COMPILE_ERROR);
+
+  PeachScript* count = peach_compile(vm, "runs = runs + 1;");
+  CHECK(count != NULL);
+  CHECK(peach_run(vm, count) == PEACH_OK);
+  CHECK(peach_run(vm, count) == PEACH_OK);
+
+  PeachValue runs;
+  CHECK(peach_get_global(vm, "runs", &runs) && is_int(runs, 2));
+}
+
+static void test_call(PeachVM* vm) {
+  PeachValue result;
+  PeachValue numbers[2] = { peach_int(2), peach_int(3) };
+  CHECK(peach_call(vm, "add", 2, numbers, &result) == PEACH_OK && is_int(result, 5));
+
+  PeachValue strings[2] = { peach_string("pe", 2), peach_string("ach", 3) };
+  CHECK(peach_call(vm, "add", 2, strings, &result) == PEACH_OK && is_string(result, "peach"));
+
+  CHECK(peach_call(vm, "missing", 0, NULL, &result) == PEACH_RUNTIME_ERROR);
+  CHECK(peach_call(vm, "add", 1, numbers, &result) == PEACH_RUNTIME_ERROR);
+  CHECK(peach_call(vm, "bad", 0, NULL, &result) == PEACH_RUNTIME_ERROR);
+
+  // errors leave the VM usable
+  CHECK(peach_call(vm, "add", 2, numbers, NULL) == PEACH_OK);
+}
+
+static void test_natives(PeachVM* vm) {
+  int calls = 0;
+  peach_define_native(vm, "host_add", host_add, &calls);
+
+  CHECK(peach_interpret(vm, "let sum = host_add(40, 2);") == PEACH_OK);
+  CHECK(calls == 1);
+
+  PeachValue sum;
+  CHECK(peach_get_global(vm, "sum", &sum) && is_int(sum, 42));
+}
+
+static void test_globals(PeachVM* vm) {
+  PeachValue value;
+
+  peach_set_global(vm, "pi", peach_number(3.5));
+  CHECK(peach_get_global(vm, "pi", &value) && value.type == PEACH_NUMBER && value.as.number == 3.5);
+
+  peach_set_global(vm, "name", peach_string("host", 4));
+  CHECK(peach_interpret(vm, "let greeting = \"hi \" + name;") == PEACH_OK);
+  CHECK(peach_get_global(vm, "greeting", &value) && is_string(value, "hi host"));
+
+  CHECK(!peach_get_global(vm, "undefined", &value));
+}
+
+static void test_reentrant_call(PeachVM* vm) {
+  peach_define_native(vm, "callback", callback, NULL);
+  peach_define_native(vm, "call_bad", call_bad, NULL);
+
+  PeachValue result;
+  PeachValue five = peach_int(5);
+  CHECK(peach_call(vm, "outer", 1, &five, &result) == PEACH_OK && is_int(result, 11));
+
+  // the error only unwinds the nested call
+  CHECK(peach_call(vm, "recover", 0, NULL, &result) == PEACH_OK && is_int(result, 9));
+  CHECK(peach_interpret(vm, "let recovered = recover() + outer(1);") == PEACH_OK);
+  CHECK(peach_get_global(vm, "recovered", &result) && is_int(result, 12));
+}
+
+static void test_invoke(PeachVM* vm) {
+  CHECK(peach_function(vm, "missing") == NULL);
+
+  PeachFunction* add = peach_function(vm, "add");
+  CHECK(add != NULL);
+
+  PeachValue result;
+  PeachValue numbers[2] = { peach_int(20), peach_int(22) };
+  CHECK(peach_invoke(vm, add, 2, numbers, &result) == PEACH_OK && is_int(result, 42));
+
+  PeachFunction* bad = peach_function(vm, "bad");
+  CHECK(peach_invoke(vm, bad, 0, NULL, &result) == PEACH_RUNTIME_ERROR);
+  CHECK(peach_invoke(vm, add, 2, numbers, &result) == PEACH_OK && is_int(result, 42));
+
+  // from a native, the frames of the script which called it carry on
+  peach_define_native(vm, "invoke_add", invoke, add);
+  CHECK(peach_interpret(vm,
+    "fn nested(x) {\n"
+    "  let before = x;\n"
+    "  return before + invoke_add(x, 1);\n"
+    "}\n"
+    "let invoked = nested(3) + nested(4);") == PEACH_OK);
+  CHECK(peach_get_global(vm, "invoked", &result) && is_int(result, 16));
+}
+
+static void test_run_too_deep(PeachVM* vm) {
+  PeachScript* nothing = peach_compile(vm, "let ran = true;");
+  CHECK(nothing != NULL);
+
+  // the script's frame and 63 calls of `deep` leave no frame for the run
+  peach_define_native(vm, "run_script", run_script, nothing);
+  CHECK(peach_interpret(vm,
+    "fn deep(n) {\n"
+    "  if n == 0 { return run_script(); }\n"
+    "  return deep(n - 1);\n"
+    "}\n"
+    "let deepest = deep(62);") == PEACH_OK);
+
+  PeachValue result;
+  CHECK(peach_get_global(vm, "deepest", &result) && is_int(result, -1));
+  CHECK(!peach_get_global(vm, "ran", &result));
+
+  // with room for it, the same script runs
+  CHECK(peach_interpret(vm, "let shallow = deep(0);") == PEACH_OK);
+  CHECK(peach_get_global(vm, "ran", &result) && result.type == PEACH_BOOL);
+}
+
+static PeachValue fresh_stats(const char* field) {
+  char source[128];
+  snprintf(source, sizeof(source), "let stat = gc_stats().%s;", field);
+
+  PeachVM* vm = peach_new();
+  PeachValue stat = peach_nil();
+
+  CHECK(peach_interpret(vm, source) == PEACH_OK);
+  CHECK(peach_get_global(vm, "stat", &stat));
+
+  peach_free(vm);
+  return stat;
+}
+
+static void test_separate_heaps(void) {
+  PeachValue strings = fresh_stats("objects_string");
+  PeachValue bytes = fresh_stats("bytes_allocated");
+
+  // another VM's allocations do not show up in a new VM's stats, even
+  // while it is alive
+  PeachVM* busy = peach_new();
+  CHECK(peach_interpret(busy, "let s = \"\"; for i in 0..1000 { s = s + \"x\"; }") == PEACH_OK);
+
+  CHECK(is_int(fresh_stats("objects_string"), strings.as.integer));
+  CHECK(is_int(fresh_stats("bytes_allocated"), bytes.as.integer));
+
+  peach_free(busy);
+}
+
+int main(void) {
+  PeachVM* vm = peach_new();
+  CHECK(peach_interpret(vm, script) == PEACH_OK);
+
+  test_compile_and_run(vm);
+  test_call(vm);
+  test_natives(vm);
+  test_globals(vm);
+  test_reentrant_call(vm);
+  test_invoke(vm);
+  test_run_too_deep(vm);
+
+  peach_free(vm);
+
+  test_separate_heaps();
+
+  if (failures > 0) {
+    fprintf(stderr, "%d checks failed.\n", failures);
+    return 1;
+  }
+
+  return 0;
+}
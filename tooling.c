@@ -0,0 +1,34 @@
+#include <stdio.h>
+#include <time.h>
+
+#include "tooling.h"
+
+uint64_t now_ns(void) {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return (uint64_t) time.tv_sec * 1000000000u + (uint64_t) time.tv_nsec;
+}
+
+size_t hash_pointer(const void* pointer) {
+  uintptr_t hash = (uintptr_t) pointer;
+  hash ^= hash >> 17;
+  hash *= 0xed5ad4bbu;
+  hash ^= hash >> 11;
+  return (size_t) hash;
+}
+
+void write_json_string(FILE* file, const char* chars) {
+  fputc('"', file);
+
+  for (const char* c = chars; *c != '\0'; c++) {
+    if (*c == '"' || *c == '\\') {
+      fprintf(file, "\\%c", *c);
+    } else if ((unsigned char) *c < 0x20) {
+      fprintf(file, "\\u%04x", *c);
+    } else {
+      fputc(*c, file);
+    }
+  }
+
+  fputc('"', file);
+}
@@ -0,0 +1,33 @@
+#ifndef peach_tooling_h
+#define peach_tooling_h
+
+#include <stdio.h>
+
+#include "common.h"
+
+/*
+ * Helpers shared by the profilers, the event trace and the heap stats.
+ *
+ * The tables and buffers of those tools are allocated with the C library
+ * rather than through reallocate(). They are tooling state, kept outside
+ * the VM's heap, so they are neither counted in the heap stats nor seen by
+ * the allocation profiler.
+ */
+
+/**
+ * The monotonic clock, in nanoseconds.
+ */
+uint64_t now_ns(void);
+
+/**
+ * Hashes a pointer for an open addressing table. The bits are mixed, as
+ * the low bits of aligned pointers are always zero.
+ */
+size_t hash_pointer(const void* pointer);
+
+/**
+ * Writes `chars` as a quoted JSON string.
+ */
+void write_json_string(FILE* file, const char* chars);
+
+#endif // !peach_tooling_h
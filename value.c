@@ -6,23 +6,57 @@
 #include <string.h>
 
 void Value_print(Value value) {
+  Output out;
+  Output_init(&out, stdout);
+  Value_write(&out, value);
+  Output_flush(&out);
+}
+
+void Value_write(Output* out, Value value) {
   switch (value.type) {
-    case VAL_NIL: printf("nil"); break;
-    case VAL_BOOL: printf(AS_BOOL(value) ? "true" : "false"); break;
-    case VAL_NUMBER: printf("%g", AS_NUMBER(value)); break;
-    case VAL_OBJECT: Object_print(value); break;
-    default: printf("unkown value type");
+    case VAL_NIL: Output_cstring(out, "nil"); break;
+    case VAL_BOOL: Output_cstring(out, AS_BOOL(value) ? "true" : "false"); break;
+    case VAL_NUMBER: Output_number(out, AS_NUMBER(value)); break;
+    case VAL_INT: Output_integer(out, AS_INT(value)); break;
+    case VAL_OBJECT: Object_write(out, value); break;
+    default: Output_cstring(out, "unkown value type");
   }
 }
 
+/**
+ * Compares an integer and a double by value, without rounding the integer.
+ */
+static bool int_equals_double(int64_t integer, double number) {
+  // doubles outside [-2^63, 2^63) or with a fraction match no integer
+  if (!(number >= -9223372036854775808.0 && number < 9223372036854775808.0)) return false;
+  return (double) (int64_t) number == number && (int64_t) number == integer;
+}
+
 bool Value_equals(Value value, Value other) {
+  if (IS_INT(value) && IS_NUMBER(other)) return int_equals_double(AS_INT(value), AS_NUMBER(other));
+  if (IS_NUMBER(value) && IS_INT(other)) return int_equals_double(AS_INT(other), AS_NUMBER(value));
   if (value.type != other.type) return false;
 
   switch (value.type) {
     case VAL_NIL:    return true;
     case VAL_BOOL:   return AS_BOOL(value) == AS_BOOL(other);
     case VAL_NUMBER: return AS_NUMBER(value) == AS_NUMBER(other);
-    case VAL_OBJECT: return AS_STRING(value) == AS_STRING(other);
+    case VAL_INT:    return AS_INT(value) == AS_INT(other);
+    case VAL_OBJECT: {
+      if (AS_OBJECT(value) == AS_OBJECT(other)) return true;
+
+      // interned strings are equal only if they are the same object, but
+      // slices and mappings are compared by their bytes
+      if (IS_STRING(value) && IS_STRING(other)) return false;
+
+      const char* a;
+      const char* b;
+      size_t a_length;
+      size_t b_length;
+
+      return Value_chars(value, &a, &a_length) && Value_chars(other, &b, &b_length) &&
+        a_length == b_length && memcmp(a, b, a_length) == 0;
+    }
     default:         return false;
   }
 }
@@ -2,6 +2,7 @@
 #define peach_value_h
 
 #include "common.h"
+#include "output.h"
 
 typedef struct Object Object;
 typedef struct ObjectString ObjectString;
@@ -10,6 +11,7 @@ typedef enum {
   VAL_BOOL,
   VAL_NIL,
   VAL_NUMBER,
+  VAL_INT,
   VAL_OBJECT,
 } ValueType;
 
@@ -18,6 +20,7 @@ typedef struct {
   union {
     bool boolean;
     double number;
+    int64_t integer;
     Object* object;
   } as;
 } Value;
@@ -25,18 +28,33 @@ typedef struct {
 #define BOOL_VAL(value)    ((Value) {VAL_BOOL, {.boolean = value}})
 #define NIL_VAL            ((Value) {VAL_NIL, {.number = 0}})
 #define NUMBER_VAL(value)  ((Value) {VAL_NUMBER, {.number = value}})
+#define INT_VAL(value)     ((Value) {VAL_INT, {.integer = value}})
 #define OBJECT_VAL(obj) ((Value) {VAL_OBJECT, {.object = (Object*) obj}})
 
 #define AS_BOOL(value)     ((value).as.boolean)
 #define AS_NUMBER(value)   ((value).as.number)
+#define AS_INT(value)      ((value).as.integer)
 #define AS_OBJECT(value)   ((value).as.object)
 
 #define IS_BOOL(value)     ((value).type == VAL_BOOL)
 #define IS_NIL(value)      ((value).type == VAL_NIL)
 #define IS_NUMBER(value)   ((value).type == VAL_NUMBER)
+#define IS_INT(value)      ((value).type == VAL_INT)
 #define IS_OBJECT(value)   ((value).type == VAL_OBJECT)
 
+// Integers and doubles are both numbers to the language; these treat them
+// alike, converting integers to double. AS_FLOAT evaluates its argument
+// twice.
+#define IS_NUMERIC(value)  (IS_NUMBER(value) || IS_INT(value))
+#define AS_FLOAT(value) \
+  (IS_INT(value) ? (double) AS_INT(value) : AS_NUMBER(value))
+
 void Value_print(Value value);
+
+/**
+ * Writes the printed form of a value to `out`, as `print` shows it.
+ */
+void Value_write(Output* out, Value value);
 bool Value_equals(Value value, Value other);
 
 
@@ -1,3 +1,4 @@
+#include "call_profiler.h"
 #include "chunk.h"
 #include "common.h"
 #include "compiler.h"
@@ -7,91 +8,238 @@
 #include "value.h"
 #include "vm.h" 
 #include "debug.h"
+#include "event_trace.h"
 
+#include <limits.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <time.h>
 
 static ObjectUpvalue* capture_upvalue(VM* vm, Value* local);
 static void close_upvalue(VM* vm, Value* last);
 static void concatenate(VM* vm);
+static bool is_text(Value value);
 static bool is_falsey(Value value);
 static void runtime_error(VM* vm, const char* fmt, ...);
-static void VM_define_native(VM* vm, const char* name, NativeFn fn);
 static void push(VM* vm, Value value);
 static Value pop(VM* vm);
 static Value peek(VM* vm, size_t depth);
 static void reset_stack(VM* vm);
+static void unwind(VM* vm, int base_frame, Value* base);
+static void define_global(VM* vm, ObjectString* name);
+static bool import_module(VM* vm, ObjectString* path);
+static bool call(VM* vm, ObjectClosure* closure, int arg_count);
+static inline bool push_frame(VM* vm, ObjectClosure* closure, int arg_count);
+static PropertyCacheEntry* cache_lookup(PropertyCache* cache, ObjectShape* shape);
+static bool resolve_property(ObjectInstance* instance, ObjectString* name,
+                             PropertyCache* cache, PropertyCacheEntry* entry);
 bool call_value(VM* vm, Value callee, uint8_t arg_count);
 
-static Value native_clock();
+static Value native_clock(VM* vm, size_t arg_count, Value* args);
+static Value native_flush(VM* vm, size_t arg_count, Value* args);
+static Value native_map_file(VM* vm, size_t arg_count, Value* args);
+static Value native_lines(VM* vm, size_t arg_count, Value* args);
+static Value native_next_line(VM* vm, size_t arg_count, Value* args);
+static Value native_slice(VM* vm, size_t arg_count, Value* args);
+static Value native_len(VM* vm, size_t arg_count, Value* args);
+static Value native_gc_stats(VM* vm, size_t arg_count, Value* args);
 
 void VM_init(VM* vm) {
+  Heap_init(&vm->heap);
+  current_heap = &vm->heap;
+
   Table_init(&vm->globals);
   Table_init(&vm->strings);
+  Table_init(&vm->modules);
   reset_stack(vm);
-  vm->objects = NULL;
+  vm->lazy_compile = false;
+  vm->call_profiler = NULL;
+  vm->gc_stats_class = NULL;
+  Output_init(&vm->out, stdout);
+
+  memset(&vm->cache_stats, 0, sizeof(vm->cache_stats));
+
+  #ifdef DEBUG_COUNT_OPCODES
+  // too large for the VM struct, which usually lives on the stack
+  vm->opcode_counts = calloc(1, sizeof(OpcodeCounts));
+  #endif
+
+  vm->init_string = NULL;
+  VM_get_intern_str(vm, "init", 4, &vm->init_string);
 
   VM_define_native(vm, "clock", native_clock);
+  VM_define_native(vm, "flush", native_flush);
+  VM_define_native(vm, "map_file", native_map_file);
+  VM_define_native(vm, "lines", native_lines);
+  VM_define_native(vm, "next_line", native_next_line);
+  VM_define_native(vm, "slice", native_slice);
+  VM_define_native(vm, "len", native_len);
+  VM_define_native(vm, "gc_stats", native_gc_stats);
 }
 
-static InterpretResult run(VM* vm) {
+#ifdef DEBUG_COUNT_OPCODES
+static void count_instruction(VM* vm, CallFrame* frame, uint8_t previous) {
+  OpcodeCounts* counts = vm->opcode_counts;
+  uint8_t op = *frame->ip;
+  ObjectFunction* function = frame->closure->function;
+
+  counts->ops[op]++;
+  counts->pairs[previous][op]++;
+
+  if (function->instruction_count++ == 0) {
+    if (counts->function_capacity < counts->function_count + 1) {
+      size_t old_capacity = counts->function_capacity;
+      counts->function_capacity = GROW_CAPACITY(old_capacity);
+      counts->functions = GROW_ARRAY(ObjectFunction*, counts->functions,
+                                     old_capacity, counts->function_capacity);
+    }
+
+    counts->functions[counts->function_count++] = function;
+  }
+}
+#endif /* ifdef DEBUG_COUNT_OPCODES */
+
+/**
+ * The dispatch loop, running frames until the one at `base_frame` returns.
+ *
+ * It is compiled twice, see run(): with `instrumented` false every check
+ * of it folds away, so tracing and profiling calls cost nothing unless
+ * they were asked for.
+ */
+static inline __attribute__((always_inline))
+InterpretResult dispatch(VM* vm, int base_frame, const bool instrumented) {
   CallFrame* frame = &vm->frames[vm->frame_count - 1];
 
+  #ifdef DEBUG_COUNT_OPCODES
+  // the first instruction of a run pairs with OP_RETURN, as if the
+  // previous run had just returned
+  uint8_t previous_op = OP_RETURN;
+  #endif
+
   #define READ_BYTE() (*(frame->ip++))
 
+  // ip is advanced once, as two increments within one expression would be
+  // unsequenced
   #define READ_SHORT() ( \
-    READ_BYTE() \
-    | (READ_BYTE() << 8) \
+    frame->ip += 2, \
+    frame->ip[-2] | (frame->ip[-1] << 8) \
   )
 
   #define READ_LONG() ( \
-    READ_BYTE() \
-    | (READ_BYTE() << 8) \
-    | (READ_BYTE() << 16) \
+    frame->ip += 3, \
+    frame->ip[-3] | (frame->ip[-2] << 8) | (frame->ip[-1] << 16) \
   )
 
   #define READ_CONSTANT() (frame->closure->function->chunk.constants.values[READ_BYTE()])
   #define READ_CONSTANT_LONG() ( \
     frame->closure->function->chunk.constants.values[READ_LONG()])
+
+  #define READ_CACHE() (&frame->closure->function->chunk.caches[READ_SHORT()])
   
   #define BINARY_OP(type_value, op) \
     do { \
       \
-      if (!IS_NUMBER(peek(vm, 0)) || !IS_NUMBER(peek(vm, 1))) { \
+      if (!IS_NUMERIC(peek(vm, 0)) || !IS_NUMERIC(peek(vm, 1))) { \
         runtime_error(vm, "Operands must be numbers."); \
+        return INTERPRET_RUNTIME_ERROR; \
       } \
       \
-      double b = AS_NUMBER(pop(vm)); \
-      double a = AS_NUMBER(pop(vm)); \
+      double b = AS_FLOAT(peek(vm, 0)); \
+      double a = AS_FLOAT(peek(vm, 1)); \
+      vm->stack_top -= 2; \
       push(vm, type_value(a op b)); \
     } while(false)
 
+  // Integer fast path for +, - and *: results which overflow 64 bits fall
+  // through to the double operation instead of wrapping.
+  #define ARITH_OP(overflow, op) \
+    do { \
+      Value right = peek(vm, 0); \
+      Value left = peek(vm, 1); \
+      int64_t result; \
+      \
+      if (IS_INT(left) && IS_INT(right) && \
+          !overflow(AS_INT(left), AS_INT(right), &result)) { \
+        vm->stack_top--; \
+        vm->stack_top[-1] = INT_VAL(result); \
+        break; \
+      } \
+      \
+      BINARY_OP(NUMBER_VAL, op); \
+    } while(false)
+
+  #define COMPARE_OP(op) \
+    do { \
+      Value right = peek(vm, 0); \
+      Value left = peek(vm, 1); \
+      \
+      if (IS_INT(left) && IS_INT(right)) { \
+        vm->stack_top--; \
+        vm->stack_top[-1] = BOOL_VAL(AS_INT(left) op AS_INT(right)); \
+        break; \
+      } \
+      \
+      BINARY_OP(BOOL_VAL, op); \
+    } while(false)
+
+  #define INTEGER_OP(op) \
+    do { \
+      if (!IS_INT(peek(vm, 0)) || !IS_INT(peek(vm, 1))) { \
+        runtime_error(vm, "Operands must be integers."); \
+        return INTERPRET_RUNTIME_ERROR; \
+      } \
+      \
+      int64_t b = AS_INT(pop(vm)); \
+      int64_t a = AS_INT(pop(vm)); \
+      push(vm, INT_VAL(op)); \
+    } while(false)
+
   for (;;) {
-    #ifdef DEBUG_TRACE_EXECUTION
-    printf("          ");
+    // frames were pushed or popped since the last instruction
+    if (instrumented && vm->call_profiler != NULL
+        && vm->call_profiler->frame_count != vm->frame_count) {
+      CallProfiler_sync(vm->call_profiler, vm);
+    }
 
-    if (vm->stack >= vm->stack_top) {
-      printf("<empty stack>");
+    if (instrumented && event_trace != NULL && event_trace->functions
+        && event_trace->frame_count != vm->frame_count) {
+      EventTrace_sync_frames(event_trace, vm);
     }
 
-    for (Value* slot = vm->stack; slot < vm->stack_top; slot++) {
-      printf("[ ");
-      Value_print(*slot);
-      printf(" ]");
+    if (instrumented && debug_flags.trace_execution) {
+      Output_flush(&vm->out);
+      printf("          ");
+
+      if (vm->stack >= vm->stack_top) {
+        printf("<empty stack>");
+      }
+
+      for (Value* slot = vm->stack; slot < vm->stack_top; slot++) {
+        printf("[ ");
+        Value_print(*slot);
+        printf(" ]");
+      }
+      printf("\n");
+
+      Chunk* chunk = &frame->closure->function->chunk;
+      disassemble_instruction(chunk, (size_t)(frame->ip - chunk->code));
     }
-    printf("\n");
 
-    disassemble_instruction(&frame->closure->function->chunk, (size_t)(frame->ip - frame->closure->function->chunk.code));
-    #endif /* ifdef DEBUG_TRACE_EXECUTION */
+    #ifdef DEBUG_COUNT_OPCODES
+    count_instruction(vm, frame, previous_op);
+    previous_op = *frame->ip;
+    #endif
 
     uint8_t instruction;
 
     switch (instruction = READ_BYTE()) {
       case OP_PRINT: {
-        Value_print(pop(vm));
-        printf("\n");
+        Value_write(&vm->out, pop(vm));
+        Output_char(&vm->out, '\n');
         break;
       }
 
@@ -100,33 +248,50 @@ static InterpretResult run(VM* vm) {
         break;
       }
 
+      case OP_PEEK: {
+        uint8_t distance = READ_BYTE();
+        push(vm, peek(vm, distance));
+        break;
+      }
+
+      case OP_POP_UNDER: {
+        uint8_t count = READ_BYTE();
+        Value top = peek(vm, 0);
+        vm->stack_top -= count;
+        vm->stack_top[-1] = top;
+        break;
+      }
+
       case OP_RETURN: {
         Value result = pop(vm);
         close_upvalue(vm, frame->slots);
         vm->frame_count--;
+        vm->stack_top = frame->slots;
+        push(vm, result);
+
+        if (vm->frame_count == base_frame) {
+          if (instrumented && vm->call_profiler != NULL) {
+            CallProfiler_sync(vm->call_profiler, vm);
+          }
+
+          if (instrumented && event_trace != NULL && event_trace->functions) {
+            EventTrace_sync_frames(event_trace, vm);
+          }
 
-        if (vm->frame_count == 0) {
-          pop(vm);
           return INTERPRET_OK;
         }
 
-        vm->stack_top = frame->slots;
-        push(vm, result);
         frame = &vm->frames[vm->frame_count - 1];
         break;
       }
 
       case OP_DEF_GLOBAL: {
-        ObjectString* name = AS_STRING(READ_CONSTANT());
-        Table_set(&vm->globals, name, peek(vm, 0));
-        pop(vm);
+        define_global(vm, AS_STRING(READ_CONSTANT()));
         break;
       }
 
       case OP_DEF_GLOBAL_LONG: {
-        ObjectString* name = AS_STRING(READ_CONSTANT_LONG());
-        Table_set(&vm->globals, name, peek(vm, 0));
-        pop(vm);
+        define_global(vm, AS_STRING(READ_CONSTANT_LONG()));
         break;
       }
 
@@ -222,6 +387,7 @@ static InterpretResult run(VM* vm) {
       case OP_SET_UPVALUE: {
         uint8_t slot = READ_BYTE();
         *frame->closure->upvalues[slot]->location = peek(vm, 0);
+        break;
       }
 
       case OP_NIL:   push(vm, NIL_VAL); break;
@@ -234,22 +400,37 @@ static InterpretResult run(VM* vm) {
         push(vm, BOOL_VAL(Value_equals(a, b)));
         break;
       }
-      case OP_GREATER: BINARY_OP(BOOL_VAL, >); break;
-      case OP_LESS:    BINARY_OP(BOOL_VAL, <); break;
+      case OP_GREATER: COMPARE_OP(>); break;
+      case OP_LESS:    COMPARE_OP(<); break;
 
       case OP_NEGATE: { 
-        if (!IS_NUMBER(peek(vm, 0))) {
+        Value value = peek(vm, 0);
+
+        if (IS_INT(value) && AS_INT(value) != INT64_MIN) {
+          vm->stack_top[-1] = INT_VAL(-AS_INT(value));
+          break;
+        }
+
+        if (!IS_NUMERIC(value)) {
           runtime_error(vm, "Operand must be a number.");
           return INTERPRET_RUNTIME_ERROR;
         }
-        push(vm, NUMBER_VAL(-AS_NUMBER(pop(vm))));
+        vm->stack_top[-1] = NUMBER_VAL(-AS_FLOAT(value));
         break;
       }
 
       case OP_ADD: {
-        if (IS_STRING(peek(vm, 0)) && IS_STRING(peek(vm, 1))) {
+        Value right = peek(vm, 0);
+        Value left = peek(vm, 1);
+        int64_t result;
+
+        if (IS_INT(left) && IS_INT(right) &&
+            !__builtin_add_overflow(AS_INT(left), AS_INT(right), &result)) {
+          vm->stack_top--;
+          vm->stack_top[-1] = INT_VAL(result);
+        } else if (is_text(peek(vm, 0)) && is_text(peek(vm, 1))) {
           concatenate(vm);
-        } else if (IS_NUMBER(peek(vm, 0)) && IS_NUMBER(peek(vm, 1))) {
+        } else if (IS_NUMERIC(peek(vm, 0)) && IS_NUMERIC(peek(vm, 1))) {
           BINARY_OP(NUMBER_VAL, +);
         } else {
           runtime_error(vm, "Operands must be two numbers or two strings.");
@@ -258,11 +439,80 @@ static InterpretResult run(VM* vm) {
 
         break;
       }
-      case OP_SUB: BINARY_OP(NUMBER_VAL, -); break;
-      case OP_MUL: BINARY_OP(NUMBER_VAL, *); break;
+      case OP_SUB: ARITH_OP(__builtin_sub_overflow, -); break;
+      case OP_MUL: ARITH_OP(__builtin_mul_overflow, *); break;
       case OP_DIV: BINARY_OP(NUMBER_VAL, /); break;
       case OP_NOT: push(vm, BOOL_VAL(is_falsey(pop(vm)))); break;
 
+      case OP_INT_DIV:
+      case OP_MOD: {
+        Value right = peek(vm, 0);
+        Value left = peek(vm, 1);
+
+        if (!IS_NUMERIC(left) || !IS_NUMERIC(right)) {
+          runtime_error(vm, "Operands must be numbers.");
+          return INTERPRET_RUNTIME_ERROR;
+        }
+
+        vm->stack_top -= 2;
+
+        if (IS_INT(left) && IS_INT(right)) {
+          int64_t a = AS_INT(left);
+          int64_t b = AS_INT(right);
+
+          if (b == 0) {
+            runtime_error(vm, "Division by zero.");
+            return INTERPRET_RUNTIME_ERROR;
+          }
+
+          if (instruction == OP_MOD) {
+            // INT64_MIN % -1 traps on x86 although the result is 0
+            push(vm, INT_VAL(b == -1 ? 0 : a % b));
+          } else if (a == INT64_MIN && b == -1) {
+            push(vm, NUMBER_VAL(-(double) INT64_MIN));
+          } else {
+            push(vm, INT_VAL(a / b));
+          }
+          break;
+        }
+
+        double a = AS_FLOAT(left);
+        double b = AS_FLOAT(right);
+        push(vm, NUMBER_VAL(instruction == OP_MOD ? fmod(a, b) : trunc(a / b)));
+        break;
+      }
+
+      case OP_BIT_AND: INTEGER_OP(a & b); break;
+      case OP_BIT_OR:  INTEGER_OP(a | b); break;
+      case OP_BIT_XOR: INTEGER_OP(a ^ b); break;
+
+      case OP_BIT_NOT: {
+        if (!IS_INT(peek(vm, 0))) {
+          runtime_error(vm, "Operand must be an integer.");
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        vm->stack_top[-1] = INT_VAL(~AS_INT(peek(vm, 0)));
+        break;
+      }
+
+      case OP_SHIFT_LEFT:
+      case OP_SHIFT_RIGHT: {
+        Value count = peek(vm, 0);
+
+        if (IS_INT(count) && (AS_INT(count) < 0 || AS_INT(count) > 63)) {
+          runtime_error(vm, "Shift count must be between 0 and 63.");
+          return INTERPRET_RUNTIME_ERROR;
+        }
+
+        if (instruction == OP_SHIFT_LEFT) {
+          // shifts out of the top bits wrap rather than promote
+          INTEGER_OP((int64_t) ((uint64_t) a << b));
+        } else {
+          INTEGER_OP(a >> b);
+        }
+        break;
+      }
+
       case OP_JUMP_IF_FALSE: {
         uint16_t offset = READ_SHORT();   
         if (is_falsey(peek(vm, 0))) frame->ip += offset;
@@ -281,27 +531,139 @@ static InterpretResult run(VM* vm) {
         break;
       }
 
+      case OP_FOR_PREP: {
+        Value* counter = &frame->slots[READ_BYTE()];
+        uint16_t offset = READ_SHORT();
+
+        if (!IS_NUMERIC(counter[0]) || !IS_NUMERIC(counter[1]) || !IS_NUMERIC(counter[2])) {
+          runtime_error(vm, "Loop range must be numbers.");
+          return INTERPRET_RUNTIME_ERROR;
+        }
+
+        // the loop counts in doubles unless all three are integers
+        if (!IS_INT(counter[0]) || !IS_INT(counter[1]) || !IS_INT(counter[2])) {
+          for (int i = 0; i < 3; i++) counter[i] = NUMBER_VAL(AS_FLOAT(counter[i]));
+        }
+
+        if (AS_FLOAT(counter[2]) == 0) {
+          runtime_error(vm, "Loop step can't be zero.");
+          return INTERPRET_RUNTIME_ERROR;
+        }
+
+        bool runs;
+        if (IS_INT(counter[0])) {
+          int64_t start = AS_INT(counter[0]), limit = AS_INT(counter[1]);
+          runs = AS_INT(counter[2]) > 0 ? start < limit : start > limit;
+        } else {
+          double start = AS_NUMBER(counter[0]), limit = AS_NUMBER(counter[1]);
+          runs = AS_NUMBER(counter[2]) > 0 ? start < limit : start > limit;
+        }
+
+        if (!runs) frame->ip += offset;
+        break;
+      }
+
+      case OP_FOR_LOOP: {
+        Value* counter = &frame->slots[READ_BYTE()];
+        uint16_t offset = READ_SHORT();
+
+        if (IS_INT(counter[0]) && IS_INT(counter[2])) {
+          int64_t step = AS_INT(counter[2]);
+          int64_t next;
+
+          // overflowing the counter has passed any integer limit
+          if (__builtin_add_overflow(AS_INT(counter[0]), step, &next)) break;
+          counter[0] = INT_VAL(next);
+
+          if (step > 0 ? next < AS_INT(counter[1]) : next > AS_INT(counter[1])) {
+            frame->ip -= offset;
+          }
+          break;
+        }
+
+        // the body assigned the counter
+        if (!IS_NUMERIC(counter[0])) {
+          runtime_error(vm, "Loop variable must be a number.");
+          return INTERPRET_RUNTIME_ERROR;
+        }
+
+        double step = AS_FLOAT(counter[2]);
+        double next = AS_FLOAT(counter[0]) + step;
+        double limit = AS_FLOAT(counter[1]);
+        counter[0] = NUMBER_VAL(next);
+
+        if (step > 0 ? next < limit : next > limit) frame->ip -= offset;
+        break;
+      }
+
       case OP_CALL: {
         uint8_t arg_count = READ_BYTE();
-        if (!call_value(vm, peek(vm, arg_count), arg_count)) {
+        Value callee = peek(vm, arg_count);
+        Chunk* chunk = &frame->closure->function->chunk;
+        size_t site = frame->ip - chunk->code - 2;
+
+        // a closure over the function this site called last has already
+        // been compiled and checked against the argument count
+        if (IS_CLOSURE(callee) && chunk->call_caches != NULL &&
+            chunk->call_caches[site] == AS_CLOSURE(callee)->function) {
+          vm->cache_stats.call_hits++;
+          if (!push_frame(vm, AS_CLOSURE(callee), arg_count)) return INTERPRET_RUNTIME_ERROR;
+
+          frame = &vm->frames[vm->frame_count - 1];
+          break;
+        }
+
+        if (!call_value(vm, callee, arg_count)) {
           return INTERPRET_RUNTIME_ERROR;
         }
 
+        if (IS_CLOSURE(callee)) {
+          vm->cache_stats.call_misses++;
+
+          if (chunk->call_caches == NULL) {
+            chunk->call_caches = ALLOCATE(ObjectFunction*, chunk->count);
+            memset(chunk->call_caches, 0, sizeof(ObjectFunction*) * chunk->count);
+          }
+
+          chunk->call_caches[site] = AS_CLOSURE(callee)->function;
+        } else {
+          vm->cache_stats.call_uncached++;
+        }
+
         frame = &vm->frames[vm->frame_count - 1];
         break;
       }
 
       case OP_CLOSURE: {
         ObjectFunction* function  = AS_FUNCTION(READ_CONSTANT());
+
+        if (function->upvalue_count == 0) {
+          push(vm, OBJECT_VAL(ObjectFunction_shared_closure(function)));
+          break;
+        }
+
         ObjectClosure* closure = ObjectClosure_crate(function);
         push(vm, OBJECT_VAL(closure));
         for (uint8_t i = 0; i < closure->upvalue_count; i++) {
-          uint8_t is_local = READ_BYTE();
+          uint8_t kind = READ_BYTE();
           uint8_t index = READ_BYTE();
-          if (is_local) {
-            closure->upvalues[i] = capture_upvalue(vm, frame->slots + index);
-          } else {
-            closure->upvalues[i] = frame->closure->upvalues[index];
+
+          switch (kind) {
+            case CAPTURE_LOCAL:
+              closure->upvalues[i] = capture_upvalue(vm, frame->slots + index);
+              break;
+
+            case CAPTURE_UPVALUE:
+              closure->upvalues[i] = frame->closure->upvalues[index];
+              break;
+
+            case CAPTURE_LOCAL_VALUE:
+              ObjectClosure_capture_value(closure, i, frame->slots[index]);
+              break;
+
+            case CAPTURE_UPVALUE_VALUE:
+              ObjectClosure_capture_value(closure, i, *frame->closure->upvalues[index]->location);
+              break;
           }
         }
         break;
@@ -312,13 +674,262 @@ static InterpretResult run(VM* vm) {
         pop(vm);
         break;
       }
+
+      case OP_IMPORT: {
+        if (!import_module(vm, AS_STRING(READ_CONSTANT()))) {
+          return INTERPRET_RUNTIME_ERROR;
+        }
+
+        frame = &vm->frames[vm->frame_count - 1];
+        break;
+      }
+
+      case OP_IMPORT_LONG: {
+        if (!import_module(vm, AS_STRING(READ_CONSTANT_LONG()))) {
+          return INTERPRET_RUNTIME_ERROR;
+        }
+
+        frame = &vm->frames[vm->frame_count - 1];
+        break;
+      }
+
+      case OP_CLASS: {
+        push(vm, OBJECT_VAL(ObjectClass_create(AS_STRING(READ_CONSTANT_LONG()))));
+        break;
+      }
+
+      case OP_INHERIT: {
+        Value superclass = peek(vm, 1);
+
+        if (!IS_CLASS(superclass)) {
+          runtime_error(vm, "Superclass must be a class.");
+          return INTERPRET_RUNTIME_ERROR;
+        }
+
+        ObjectClass* subclass = AS_CLASS(peek(vm, 0));
+        Table_add_all(&subclass->methods, &AS_CLASS(superclass)->methods);
+        subclass->initializer = AS_CLASS(superclass)->initializer;
+        pop(vm);
+        break;
+      }
+
+      case OP_METHOD: {
+        ObjectString* name = AS_STRING(READ_CONSTANT_LONG());
+        ObjectClass* klass = AS_CLASS(peek(vm, 1));
+        Table_set(&klass->methods, name, peek(vm, 0));
+
+        if (name == vm->init_string) klass->initializer = AS_CLOSURE(peek(vm, 0));
+        pop(vm);
+        break;
+      }
+
+      case OP_GET_PROPERTY: {
+        ObjectString* name = AS_STRING(READ_CONSTANT_LONG());
+        PropertyCache* cache = READ_CACHE();
+
+        if (!IS_INSTANCE(peek(vm, 0))) {
+          runtime_error(vm, "Only instances have properties.");
+          return INTERPRET_RUNTIME_ERROR;
+        }
+
+        ObjectInstance* instance = AS_INSTANCE(peek(vm, 0));
+        PropertyCacheEntry* entry = cache_lookup(cache, instance->shape);
+        PropertyCacheEntry miss;
+
+        if (entry != NULL) {
+          vm->cache_stats.property_hits++;
+        } else {
+          vm->cache_stats.property_misses++;
+          entry = &miss;
+
+          if (!resolve_property(instance, name, cache, entry)) {
+            runtime_error(vm, "Undefined property '%s'.", name->chars);
+            return INTERPRET_RUNTIME_ERROR;
+          }
+        }
+
+        vm->stack_top[-1] = entry->method != NULL
+          ? OBJECT_VAL(ObjectBoundMethod_create(peek(vm, 0), entry->method))
+          : instance->fields[entry->slot];
+        break;
+      }
+
+      case OP_SET_PROPERTY: {
+        ObjectString* name = AS_STRING(READ_CONSTANT_LONG());
+        PropertyCache* cache = READ_CACHE();
+
+        if (!IS_INSTANCE(peek(vm, 1))) {
+          runtime_error(vm, "Only instances have fields.");
+          return INTERPRET_RUNTIME_ERROR;
+        }
+
+        ObjectInstance* instance = AS_INSTANCE(peek(vm, 1));
+        PropertyCacheEntry* entry = cache_lookup(cache, instance->shape);
+        PropertyCacheEntry miss;
+
+        if (entry != NULL) {
+          vm->cache_stats.property_hits++;
+        } else {
+          vm->cache_stats.property_misses++;
+          int64_t slot = ObjectShape_find(instance->shape, name);
+
+          entry = &miss;
+          entry->shape = instance->shape;
+          entry->method = NULL;
+          entry->transition = NULL;
+
+          if (slot == -1) {
+            entry->transition = ObjectShape_transition(instance->shape, name);
+            slot = entry->transition->field_count - 1;
+          }
+
+          entry->slot = (uint32_t) slot;
+          if (cache->count < PROPERTY_CACHE_WAYS) cache->entries[cache->count++] = miss;
+        }
+
+        if (entry->transition != NULL) ObjectInstance_reshape(instance, entry->transition);
+
+        Value value = pop(vm);
+        instance->fields[entry->slot] = value;
+        vm->stack_top[-1] = value;
+        break;
+      }
+
+      case OP_INVOKE: {
+        ObjectString* name = AS_STRING(READ_CONSTANT_LONG());
+        uint8_t arg_count = READ_BYTE();
+        PropertyCache* cache = READ_CACHE();
+        Value receiver = peek(vm, arg_count);
+
+        if (!IS_INSTANCE(receiver)) {
+          runtime_error(vm, "Only instances have methods.");
+          return INTERPRET_RUNTIME_ERROR;
+        }
+
+        ObjectInstance* instance = AS_INSTANCE(receiver);
+        PropertyCacheEntry* entry = cache_lookup(cache, instance->shape);
+        PropertyCacheEntry miss;
+
+        if (entry != NULL) {
+          vm->cache_stats.property_hits++;
+        } else {
+          vm->cache_stats.property_misses++;
+          entry = &miss;
+
+          if (!resolve_property(instance, name, cache, entry)) {
+            runtime_error(vm, "Undefined property '%s'.", name->chars);
+            return INTERPRET_RUNTIME_ERROR;
+          }
+        }
+
+        if (entry->method != NULL) {
+          if (!call(vm, entry->method, arg_count)) return INTERPRET_RUNTIME_ERROR;
+        } else {
+          // a field holding something callable
+          Value callee = instance->fields[entry->slot];
+          vm->stack_top[-arg_count - 1] = callee;
+          if (!call_value(vm, callee, arg_count)) return INTERPRET_RUNTIME_ERROR;
+        }
+
+        frame = &vm->frames[vm->frame_count - 1];
+        break;
+      }
+
+      case OP_GET_SUPER: {
+        ObjectString* name = AS_STRING(READ_CONSTANT_LONG());
+        ObjectClass* superclass = AS_CLASS(pop(vm));
+        Value method;
+
+        if (!Table_get(&superclass->methods, name, &method)) {
+          runtime_error(vm, "Undefined property '%s'.", name->chars);
+          return INTERPRET_RUNTIME_ERROR;
+        }
+
+        vm->stack_top[-1] = OBJECT_VAL(ObjectBoundMethod_create(peek(vm, 0), AS_CLOSURE(method)));
+        break;
+      }
+
+      case OP_SUPER_INVOKE: {
+        ObjectString* name = AS_STRING(READ_CONSTANT_LONG());
+        uint8_t arg_count = READ_BYTE();
+        ObjectClass* superclass = AS_CLASS(pop(vm));
+        Value method;
+
+        if (!Table_get(&superclass->methods, name, &method)) {
+          runtime_error(vm, "Undefined property '%s'.", name->chars);
+          return INTERPRET_RUNTIME_ERROR;
+        }
+
+        if (!call(vm, AS_CLOSURE(method), arg_count)) return INTERPRET_RUNTIME_ERROR;
+
+        frame = &vm->frames[vm->frame_count - 1];
+        break;
+      }
     }
   }
 
   #undef READ_BYTE
-  #undef READ_SHORT 
+  #undef READ_SHORT
   #undef READ_CONSTANT
   #undef READ_CONSTANT_LONG
+  #undef READ_CACHE
+}
+
+// Kept out of run() so each copy is optimized on its own, with the
+// instrumented one laid out away from the hot code.
+static __attribute__((noinline, hot)) InterpretResult run_lean(VM* vm, int base_frame) {
+  return dispatch(vm, base_frame, false);
+}
+
+static __attribute__((noinline, cold)) InterpretResult run_instrumented(VM* vm, int base_frame) {
+  return dispatch(vm, base_frame, true);
+}
+
+static InterpretResult run(VM* vm, int base_frame) {
+  if (debug_flags.trace_execution || vm->call_profiler != NULL
+      || (event_trace != NULL && event_trace->functions)) {
+    return run_instrumented(vm, base_frame);
+  }
+
+  return run_lean(vm, base_frame);
+}
+
+static PropertyCacheEntry* cache_lookup(PropertyCache* cache, ObjectShape* shape) {
+  for (uint8_t i = 0; i < cache->count; i++) {
+    if (cache->entries[i].shape == shape) return &cache->entries[i];
+  }
+
+  return NULL;
+}
+
+/**
+ * Looks up a property the slow way, first among the instance's fields and
+ * then among its class's methods, and fills in `entry` with where it was
+ * found. The entry is also added to `cache` unless the site has already
+ * seen PROPERTY_CACHE_WAYS shapes.
+ *
+ * Returns false if the instance has no such property.
+ */
+static bool resolve_property(ObjectInstance* instance, ObjectString* name,
+                             PropertyCache* cache, PropertyCacheEntry* entry) {
+  entry->shape = instance->shape;
+  entry->slot = 0;
+  entry->transition = NULL;
+  entry->method = NULL;
+
+  int64_t slot = ObjectShape_find(instance->shape, name);
+  Value method;
+
+  if (slot != -1) {
+    entry->slot = (uint32_t) slot;
+  } else if (Table_get(&instance->klass->methods, name, &method)) {
+    entry->method = AS_CLOSURE(method);
+  } else {
+    return false;
+  }
+
+  if (cache->count < PROPERTY_CACHE_WAYS) cache->entries[cache->count++] = *entry;
+  return true;
 }
 
 static ObjectUpvalue* capture_upvalue(VM* vm, Value* local) {
@@ -354,13 +965,12 @@ static void close_upvalue(VM* vm, Value* last) {
   }
 }
 
-static bool call(VM* vm, ObjectClosure* closure, int arg_count) {
-  const ObjectFunction* fn = closure->function;
-
-  if (arg_count != fn->arity) {
-    runtime_error(vm, "Expected %d arguments but got %d.", fn->arity, arg_count);
-    return false;
-  }
+/**
+ * Pushes a frame for a closure whose function is compiled and takes
+ * `arg_count` arguments.
+ */
+static inline bool push_frame(VM* vm, ObjectClosure* closure, int arg_count) {
+  ObjectFunction* fn = closure->function;
 
   if (vm->frame_count == FRAMES_MAX) {
     runtime_error(vm, "Stack overflow");
@@ -374,6 +984,22 @@ static bool call(VM* vm, ObjectClosure* closure, int arg_count) {
   return true;
 }
 
+static bool call(VM* vm, ObjectClosure* closure, int arg_count) {
+  ObjectFunction* fn = closure->function;
+
+  if (fn->lazy_source != NULL && !compile_lazy(vm, fn)) {
+    runtime_error(vm, "Could not compile function '%s'.", fn->name->chars);
+    return false;
+  }
+
+  if (arg_count != fn->arity) {
+    runtime_error(vm, "Expected %d arguments but got %d.", fn->arity, arg_count);
+    return false;
+  }
+
+  return push_frame(vm, closure, arg_count);
+}
+
 bool call_value(VM* vm, Value callee, uint8_t arg_count) {
   if (IS_OBJECT(callee)) {
     switch (OBJECT_TYPE(callee)) {
@@ -381,9 +1007,47 @@ bool call_value(VM* vm, Value callee, uint8_t arg_count) {
         return call(vm, AS_CLOSURE(callee), arg_count);
       }
 
+      case OBJ_CLASS: {
+        ObjectClass* klass = AS_CLASS(callee);
+        vm->stack_top[-arg_count - 1] = OBJECT_VAL(ObjectInstance_create(klass));
+
+        if (klass->initializer != NULL) return call(vm, klass->initializer, arg_count);
+
+        if (arg_count != 0) {
+          runtime_error(vm, "Expected 0 arguments but got %d.", arg_count);
+          return false;
+        }
+
+        return true;
+      }
+
+      case OBJ_BOUND_METHOD: {
+        ObjectBoundMethod* bound = AS_BOUND_METHOD(callee);
+        vm->stack_top[-arg_count - 1] = bound->receiver;
+        return call(vm, bound->method, arg_count);
+      }
+
       case OBJ_NATIVE_FN: {
         NativeFn fn = AS_NATIVE_FN(callee);
-        Value result = fn(arg_count, vm->stack_top - arg_count);
+
+        if (vm->call_profiler != NULL) {
+          CallProfiler_enter_native(vm->call_profiler, AS_NATIVE(callee));
+        }
+
+        if (event_trace != NULL) {
+          EventTrace_begin(event_trace, "native", AS_NATIVE(callee)->name->chars);
+        }
+
+        Value result = fn(vm, arg_count, vm->stack_top - arg_count);
+
+        if (event_trace != NULL) {
+          EventTrace_end(event_trace, "native", AS_NATIVE(callee)->name->chars);
+        }
+
+        if (vm->call_profiler != NULL) {
+          CallProfiler_exit_native(vm->call_profiler, vm);
+        }
+
         vm->stack_top -= arg_count + 1;
         push(vm, result);
         return true;
@@ -397,17 +1061,306 @@ bool call_value(VM* vm, Value callee, uint8_t arg_count) {
   return false;
 }
 
+void VM_print_stats(VM* vm) {
+  CacheStats* stats = &vm->cache_stats;
+  uint64_t calls = stats->call_hits + stats->call_misses;
+  uint64_t accesses = stats->property_hits + stats->property_misses;
+
+  Output_flush(&vm->out);
+  fprintf(stderr, "-- call sites: %llu hits, %llu misses (%.2f%% hit rate), %llu uncached calls\n",
+          (unsigned long long) stats->call_hits, (unsigned long long) stats->call_misses,
+          calls > 0 ? 100.0 * stats->call_hits / calls : 0.0,
+          (unsigned long long) stats->call_uncached);
+  fprintf(stderr, "-- property sites: %llu hits, %llu misses (%.2f%% hit rate)\n",
+          (unsigned long long) stats->property_hits, (unsigned long long) stats->property_misses,
+          accesses > 0 ? 100.0 * stats->property_hits / accesses : 0.0);
+
+  HeapStats heap;
+  VM_heap_stats(vm, &heap);
+  fprintf(stderr, "-- heap: %zu bytes allocated, %zu peak, %llu in total\n",
+          heap.bytes_allocated, heap.peak_bytes_allocated,
+          (unsigned long long) heap.total_bytes_allocated);
+  fprintf(stderr, "-- interned strings: %zu in %zu slots (%.2f load factor)\n",
+          heap.interned_strings, heap.intern_capacity, heap.intern_load_factor);
+  fprintf(stderr, "-- collections: %llu, %.3f ms paused\n",
+          (unsigned long long) heap.collections, heap.total_pause_ns / 1e6);
+}
+
+void VM_heap_stats(VM* vm, HeapStats* stats) {
+  *stats = vm->heap.stats;
+  stats->interned_strings = vm->strings.count;
+  stats->intern_capacity = vm->strings.capacity;
+  stats->intern_load_factor = vm->strings.capacity > 0
+    ? (double) vm->strings.count / vm->strings.capacity : 0.0;
+}
+
+#ifdef DEBUG_COUNT_OPCODES
+typedef struct {
+  uint8_t first;
+  uint8_t second;
+  uint64_t count;
+} OpcodePair;
+
+static int compare_pairs(const void* a, const void* b) {
+  uint64_t x = ((const OpcodePair*) a)->count;
+  uint64_t y = ((const OpcodePair*) b)->count;
+  return (x < y) - (x > y);
+}
+
+static int compare_functions(const void* a, const void* b) {
+  uint64_t x = (*(ObjectFunction* const*) a)->instruction_count;
+  uint64_t y = (*(ObjectFunction* const*) b)->instruction_count;
+  return (x < y) - (x > y);
+}
+
+// Number of opcode pairs and functions listed in the report.
+#define OPCODE_REPORT_TOP 30
+
+void VM_print_opcode_counts(VM* vm) {
+  OpcodeCounts* counts = vm->opcode_counts;
+  OpcodePair* ops = malloc(sizeof(OpcodePair) * UINT8_COUNT);
+  OpcodePair* pairs = malloc(sizeof(OpcodePair) * UINT8_COUNT * UINT8_COUNT);
+  size_t op_count = 0;
+  size_t pair_count = 0;
+  uint64_t total = 0;
+
+  for (int a = 0; a < UINT8_COUNT; a++) {
+    if (counts->ops[a] > 0) {
+      ops[op_count++] = (OpcodePair) { a, 0, counts->ops[a] };
+      total += counts->ops[a];
+    }
+
+    for (int b = 0; b < UINT8_COUNT; b++) {
+      if (counts->pairs[a][b] > 0) {
+        pairs[pair_count++] = (OpcodePair) { a, b, counts->pairs[a][b] };
+      }
+    }
+  }
+
+  qsort(ops, op_count, sizeof(OpcodePair), compare_pairs);
+  qsort(pairs, pair_count, sizeof(OpcodePair), compare_pairs);
+  qsort(counts->functions, counts->function_count, sizeof(ObjectFunction*), compare_functions);
+
+  Output_flush(&vm->out);
+  fprintf(stderr, "-- %llu instructions executed\n", (unsigned long long) total);
+
+  fprintf(stderr, "-- opcodes:\n");
+  for (size_t i = 0; i < op_count; i++) {
+    fprintf(stderr, "%-20s %14llu %6.2f%%\n", opcode_name(ops[i].first),
+            (unsigned long long) ops[i].count, 100.0 * ops[i].count / total);
+  }
+
+  fprintf(stderr, "-- opcode pairs:\n");
+  for (size_t i = 0; i < pair_count && i < OPCODE_REPORT_TOP; i++) {
+    fprintf(stderr, "%-20s %-20s %14llu %6.2f%%\n",
+            opcode_name(pairs[i].first), opcode_name(pairs[i].second),
+            (unsigned long long) pairs[i].count, 100.0 * pairs[i].count / total);
+  }
+
+  fprintf(stderr, "-- functions:\n");
+  for (size_t i = 0; i < counts->function_count && i < OPCODE_REPORT_TOP; i++) {
+    ObjectFunction* function = counts->functions[i];
+    fprintf(stderr, "%-20s %14llu %6.2f%%\n",
+            function->name != NULL ? function->name->chars : "script",
+            (unsigned long long) function->instruction_count,
+            100.0 * function->instruction_count / total);
+  }
+
+  free(ops);
+  free(pairs);
+}
+#endif /* ifdef DEBUG_COUNT_OPCODES */
+
 InterpretResult VM_interpret(VM* vm, const char *source) {
   ObjectFunction* fn = compile(vm, source);
   if (fn == NULL) return INTERPRET_COMPILE_ERROR;
 
-  push(vm, OBJECT_VAL(fn));
-  ObjectClosure* closure = ObjectClosure_crate(fn);
+  return VM_run_function(vm, fn);
+}
+
+InterpretResult VM_run_function(VM* vm, ObjectFunction* function) {
+  Value* base = vm->stack_top;
+  int base_frame = vm->frame_count;
+
+  push(vm, OBJECT_VAL(function));
+  ObjectClosure* closure = ObjectClosure_crate(function);
+  pop(vm);
+  push(vm, OBJECT_VAL(closure));
+
+  // too deep to start, or a lazy body which does not compile
+  if (!call(vm, closure, 0)) {
+    unwind(vm, base_frame, base);
+    return INTERPRET_RUNTIME_ERROR;
+  }
+
+  if (event_trace != NULL) EventTrace_begin(event_trace, "vm", "run");
+
+  InterpretResult result = run(vm, base_frame);
+
+  if (result == INTERPRET_OK) {
+    // the script's own return value
+    pop(vm);
+  } else {
+    unwind(vm, base_frame, base);
+  }
+
+  if (event_trace != NULL) {
+    // a runtime error unwinds frames without returning from them
+    if (event_trace->functions) EventTrace_sync_frames(event_trace, vm);
+    EventTrace_end(event_trace, "vm", "run");
+  }
+
+  return result;
+}
+
+InterpretResult VM_call(VM* vm, Value callee, int arg_count, const Value* args, Value* result) {
+  if (arg_count > UINT8_MAX) {
+    runtime_error(vm, "Can't pass more than %d arguments.", UINT8_MAX);
+    return INTERPRET_RUNTIME_ERROR;
+  }
+
+  Value* base = vm->stack_top;
+  int base_frame = vm->frame_count;
+
+  push(vm, callee);
+  for (int i = 0; i < arg_count; i++) {
+    push(vm, args[i]);
+  }
+
+  // natives and classes without initializers are done after call_value()
+  if (!call_value(vm, callee, arg_count) ||
+      (vm->frame_count > base_frame && run(vm, base_frame) != INTERPRET_OK)) {
+    unwind(vm, base_frame, base);
+    return INTERPRET_RUNTIME_ERROR;
+  }
+
+  *result = pop(vm);
+  vm->stack_top = base;
+  return INTERPRET_OK;
+}
+
+static void define_global(VM* vm, ObjectString* name) {
+  Table_set(&vm->globals, name, peek(vm, 0));
   pop(vm);
+}
+
+/**
+ * Reads a whole file into a newly allocated buffer.
+ * Returns NULL if the file could not be read.
+ */
+static char* read_source(const char* path) {
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) return NULL;
+
+  fseek(file, 0L, SEEK_END);
+  size_t file_size = ftell(file);
+  rewind(file);
+
+  char* buffer = (char*) malloc(file_size + 1);
+  if (buffer == NULL) {
+    fclose(file);
+    return NULL;
+  }
+
+  size_t bytes_read = fread(buffer, sizeof(char), file_size, file);
+  fclose(file);
+
+  if (bytes_read < file_size) {
+    free(buffer);
+    return NULL;
+  }
+
+  buffer[bytes_read] = '\0';
+  return buffer;
+}
+
+/**
+ * Returns the module cached for the canonical path `resolved`, creating
+ * it if it has not been seen yet.
+ */
+static ObjectModule* find_module(VM* vm, const char* resolved) {
+  ObjectString* key;
+  VM_get_intern_str(vm, resolved, strlen(resolved), &key);
+
+  Value cached;
+  if (Table_get(&vm->modules, key, &cached)) return AS_MODULE(cached);
+
+  ObjectModule* module = ObjectModule_create(key);
+  Table_set(&vm->modules, key, OBJECT_VAL(module));
+  return module;
+}
+
+void VM_enter_main(VM* vm, const char* path) {
+  char resolved[PATH_MAX];
+  if (realpath(path, resolved) == NULL) return;
+
+  find_module(vm, resolved)->loading = true;
+}
+
+/**
+ * Runs the module at `path`, which is resolved relative to the working
+ * directory. Its top-level code defines globals like any other script.
+ *
+ * Modules are cached by canonical path. If the file has not been modified
+ * since it was last loaded, importing it again does nothing: the globals
+ * it defined are already there, with whatever values they have since been
+ * given.
+ */
+static bool import_module(VM* vm, ObjectString* path) {
+  char resolved[PATH_MAX];
+  struct stat st;
+
+  if (realpath(path->chars, resolved) == NULL || stat(resolved, &st) != 0) {
+    runtime_error(vm, "Could not open module \"%s\".", path->chars);
+    return false;
+  }
+
+  ObjectModule* module = find_module(vm, resolved);
+
+  if (module->loading) {
+    runtime_error(vm, "Cyclic import of module \"%s\".", path->chars);
+    return false;
+  }
+
+  if (module->function != NULL &&
+      module->mtime.tv_sec == st.st_mtim.tv_sec &&
+      module->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+    return true;
+  }
+
+  char* source = read_source(resolved);
+  if (source == NULL) {
+    runtime_error(vm, "Could not read module \"%s\".", path->chars);
+    return false;
+  }
+
+  ObjectFunction* function = compile(vm, source);
+  free(source);
+
+  if (function == NULL) {
+    runtime_error(vm, "Could not compile module \"%s\".", path->chars);
+    return false;
+  }
+
+  module->function = function;
+  module->loading = true;
+
+  ObjectClosure* closure = ObjectClosure_crate(function);
   push(vm, OBJECT_VAL(closure));
-  call(vm, closure, 0);
 
-  return run(vm);
+  int base_frame = vm->frame_count;
+  bool ok = call(vm, closure, 0) && run(vm, base_frame) == INTERPRET_OK;
+
+  // the module's return value
+  if (ok) pop(vm);
+
+  module->loading = false;
+
+  if (ok) {
+    module->mtime = st.st_mtim;
+  }
+
+  return ok;
 }
 
 bool VM_get_intern_str(VM* vm, const char* chars, size_t length, ObjectString** dest) {
@@ -426,19 +1379,57 @@ bool VM_get_intern_str(VM* vm, const char* chars, size_t length, ObjectString**
 }
 
 void VM_free(VM* vm) {
+  current_heap = &vm->heap;
+  Output_flush(&vm->out);
   Table_free(&vm->strings);
   Table_free(&vm->globals);
-  free_objects(vm->objects);
+  Table_free(&vm->modules);
+  free_objects(vm->heap.objects);
+  vm->heap.objects = NULL;
+
+  #ifdef DEBUG_COUNT_OPCODES
+  FREE_ARRAY(ObjectFunction*, vm->opcode_counts->functions, vm->opcode_counts->function_capacity);
+  free(vm->opcode_counts);
+  #endif
+
+  current_heap = NULL;
+}
+
+ObjectString* VM_materialize(VM* vm, Value value) {
+  if (IS_STRING(value)) return AS_STRING(value);
+
+  const char* chars;
+  size_t length;
+  Value_chars(value, &chars, &length);
+
+  ObjectString* str;
+  VM_get_intern_str(vm, chars, length, &str);
+  return str;
+}
+
+static bool is_text(Value value) {
+  const char* chars;
+  size_t length;
+  return Value_chars(value, &chars, &length);
 }
 
+/**
+ * Concatenates the two string-like values on top of the stack into a new
+ * interned string.
+ */
 static void concatenate(VM* vm) {
-  ObjectString* b = AS_STRING(pop(vm));
-  ObjectString* a = AS_STRING(pop(vm));
-  size_t length = a->length + b->length;
+  const char* a;
+  const char* b;
+  size_t a_length;
+  size_t b_length;
+
+  Value_chars(peek(vm, 0), &b, &b_length);
+  Value_chars(peek(vm, 1), &a, &a_length);
+  size_t length = a_length + b_length;
 
   ObjectString* dest = Table_find_str_combined(
-    &vm->strings, a->chars, a->length,
-    b->chars, b->length
+    &vm->strings, a, a_length,
+    b, b_length
   );
   if (dest != NULL) {
     goto end;
@@ -446,12 +1437,15 @@ static void concatenate(VM* vm) {
 
   char* str = ALLOCATE(char, length + 1);
 
-  memcpy(str, a->chars, a->length);
-  memcpy(str + a->length, b->chars, b->length);
+  memcpy(str, a, a_length);
+  memcpy(str + a_length, b, b_length);
   str[length] = '\0';
   dest = ObjectString_take(str, length);
+  Table_set(&vm->strings, dest, NIL_VAL);
 
   end:
+  pop(vm);
+  pop(vm);
   push(vm, OBJECT_VAL(dest));
 }
 
@@ -460,6 +1454,8 @@ static bool is_falsey(Value value) {
 }
 
 static void runtime_error(VM* vm, const char* fmt, ...) {
+  Output_flush(&vm->out);
+
   va_list args;
   va_start(args, fmt);
   vfprintf(stderr, fmt, args);
@@ -480,25 +1476,172 @@ static void runtime_error(VM* vm, const char* fmt, ...) {
       fprintf(stderr, "%s()\n", function->name->chars);
     }
   }
+}
 
+/**
+ * Drops the frames above `base_frame` and the stack above `base` after a
+ * runtime error, closing the upvalues which still point into it. Frames
+ * below belong to a run which called into the VM, and carry on.
+ */
+static void unwind(VM* vm, int base_frame, Value* base) {
+  close_upvalue(vm, base);
+  vm->stack_top = base;
+  vm->frame_count = base_frame;
+}
+
+void VM_reset_stack(VM* vm) {
   reset_stack(vm);
 }
 
-static void VM_define_native(VM* vm, const char* name, NativeFn fn) {
+ObjectNativeFn* VM_define_native(VM* vm, const char* name, NativeFn fn) {
   ObjectString* str;
   VM_get_intern_str(vm, name, strlen(name), &str);
 
   push(vm, OBJECT_VAL(str));
-  push(vm, OBJECT_VAL(ObjectNativeFn_create(fn)));
-  Table_set(&vm->globals, AS_STRING(vm->stack[0]), vm->stack[1]);
+  ObjectNativeFn* native = ObjectNativeFn_create(str, fn);
+  push(vm, OBJECT_VAL(native));
+  Table_set(&vm->globals, str, peek(vm, 0));
   pop(vm);
   pop(vm);
+
+  return native;
 }
 
-static Value native_clock() {
+static Value native_clock(VM* vm, size_t arg_count, Value* args) {
   return NUMBER_VAL((double) clock() / CLOCKS_PER_SEC);
 }
 
+static Value native_flush(VM* vm, size_t arg_count, Value* args) {
+  Output_flush(&vm->out);
+  return NIL_VAL;
+}
+
+/**
+ * map_file(path): the contents of a file, mapped into memory rather than
+ * read. Returns nil if the file can not be mapped.
+ */
+static Value native_map_file(VM* vm, size_t arg_count, Value* args) {
+  if (arg_count != 1 || !is_text(args[0])) return NIL_VAL;
+
+  ObjectMapping* mapping = ObjectMapping_open(VM_materialize(vm, args[0])->chars);
+  return mapping != NULL ? OBJECT_VAL(mapping) : NIL_VAL;
+}
+
+/**
+ * lines(mapping): an iterator over the lines of a mapped file.
+ */
+static Value native_lines(VM* vm, size_t arg_count, Value* args) {
+  if (arg_count != 1 || !IS_MAPPING(args[0])) return NIL_VAL;
+  return OBJECT_VAL(ObjectLineIterator_create(AS_MAPPING(args[0])));
+}
+
+/**
+ * next_line(iterator): the next line as a slice of the mapped file, without
+ * copying it, or nil after the last line.
+ */
+static Value native_next_line(VM* vm, size_t arg_count, Value* args) {
+  if (arg_count != 1 || !IS_LINE_ITERATOR(args[0])) return NIL_VAL;
+
+  ObjectSlice* line = ObjectLineIterator_next(AS_LINE_ITERATOR(args[0]));
+  return line != NULL ? OBJECT_VAL(line) : NIL_VAL;
+}
+
+/**
+ * slice(string, start, length): `length` bytes of a string, slice or mapping
+ * from `start` on, sharing its bytes. Returns nil if the range is out of
+ * bounds.
+ */
+static Value native_slice(VM* vm, size_t arg_count, Value* args) {
+  const char* chars;
+  size_t length;
+
+  if (arg_count != 3 || !Value_chars(args[0], &chars, &length) ||
+      !IS_NUMERIC(args[1]) || !IS_NUMERIC(args[2])) {
+    return NIL_VAL;
+  }
+
+  double start = AS_FLOAT(args[1]);
+  double count = AS_FLOAT(args[2]);
+
+  // range-checked as doubles first, as converting one out of range (or
+  // NaN) to size_t is undefined; the negated test also rejects NaN
+  if (!(start >= 0 && count >= 0 && start + count <= length)) return NIL_VAL;
+  if (start != (size_t) start || count != (size_t) count) return NIL_VAL;
+
+  // slices of slices share the original parent
+  Object* parent = IS_SLICE(args[0]) ? AS_SLICE(args[0])->parent : AS_OBJECT(args[0]);
+  return OBJECT_VAL(ObjectSlice_create(parent, chars + (size_t) start, (size_t) count));
+}
+
+/**
+ * len(string): the length in bytes of a string, slice or mapping.
+ */
+static Value native_len(VM* vm, size_t arg_count, Value* args) {
+  const char* chars;
+  size_t length;
+
+  if (arg_count != 1 || !Value_chars(args[0], &chars, &length)) return NIL_VAL;
+  return INT_VAL((int64_t) length);
+}
+
+static void set_stats_field(VM* vm, ObjectInstance* instance, const char* name, Value value) {
+  ObjectString* key;
+  VM_get_intern_str(vm, name, strlen(name), &key);
+
+  ObjectShape* shape = ObjectShape_transition(instance->shape, key);
+  ObjectInstance_reshape(instance, shape);
+  instance->fields[shape->field_count - 1] = value;
+}
+
+/**
+ * gc_stats(): a GCStats instance with the fields of VM_heap_stats(). The
+ * objects of each type the VM holds are in `objects_<type>` fields, and the pause
+ * histogram in `pauses_under_<n>us` fields followed by `pauses_over_<n>us`
+ * for the longest ones.
+ */
+static Value native_gc_stats(VM* vm, size_t arg_count, Value* args) {
+  if (arg_count != 0) return NIL_VAL;
+
+  HeapStats stats;
+  VM_heap_stats(vm, &stats);
+
+  if (vm->gc_stats_class == NULL) {
+    ObjectString* name;
+    VM_get_intern_str(vm, "GCStats", 7, &name);
+    vm->gc_stats_class = ObjectClass_create(name);
+  }
+
+  ObjectInstance* instance = ObjectInstance_create(vm->gc_stats_class);
+  push(vm, OBJECT_VAL(instance));
+
+  set_stats_field(vm, instance, "bytes_allocated", INT_VAL((int64_t) stats.bytes_allocated));
+  set_stats_field(vm, instance, "peak_bytes_allocated", INT_VAL((int64_t) stats.peak_bytes_allocated));
+  set_stats_field(vm, instance, "total_bytes_allocated", INT_VAL((int64_t) stats.total_bytes_allocated));
+  set_stats_field(vm, instance, "interned_strings", INT_VAL((int64_t) stats.interned_strings));
+  set_stats_field(vm, instance, "intern_load_factor", NUMBER_VAL(stats.intern_load_factor));
+  set_stats_field(vm, instance, "collections", INT_VAL((int64_t) stats.collections));
+  set_stats_field(vm, instance, "pause_ns", INT_VAL((int64_t) stats.total_pause_ns));
+
+  char name[64];
+
+  for (int type = 0; type < OBJ_TYPE_COUNT; type++) {
+    snprintf(name, sizeof(name), "objects_%s", ObjectType_name(type));
+    set_stats_field(vm, instance, name, INT_VAL((int64_t) stats.objects[type]));
+  }
+
+  for (int bucket = 0; bucket < GC_PAUSE_BUCKETS; bucket++) {
+    if (bucket < GC_PAUSE_BUCKETS - 1) {
+      snprintf(name, sizeof(name), "pauses_under_%dus", 1 << bucket);
+    } else {
+      snprintf(name, sizeof(name), "pauses_over_%dus", 1 << (bucket - 1));
+    }
+
+    set_stats_field(vm, instance, name, INT_VAL((int64_t) stats.pauses[bucket]));
+  }
+
+  return pop(vm);
+}
+
 static void push(VM* vm, Value value) {
   *vm->stack_top = value;
   vm->stack_top++;
@@ -518,4 +1661,3 @@ static void reset_stack(VM* vm) {
   vm->frame_count = 0;
   vm->open_upvalues = NULL;
 }
-
@@ -1,7 +1,9 @@
 #ifndef peach_vm_h
 #define peach_vm_h
 
+#include "memory.h"
 #include "object.h"
+#include "output.h"
 #include "chunk.h"
 #include "value.h"
 #include "table.h"
@@ -15,7 +17,34 @@ typedef struct {
   Value* slots;
 } CallFrame;
 
+/**
+ * Hit and miss counts of the inline caches, reported by `--stats`.
+ * Calls of natives, classes and bound methods are not cached.
+ */
+typedef struct {
+  uint64_t call_hits;
+  uint64_t call_misses;
+  uint64_t call_uncached;
+  uint64_t property_hits;
+  uint64_t property_misses;
+} CacheStats;
+
+/**
+ * Execution counts of every opcode, of every pair of consecutive opcodes
+ * and of the instructions of each function, kept in builds with
+ * DEBUG_COUNT_OPCODES to find candidates for superinstructions.
+ */
 typedef struct {
+  uint64_t ops[UINT8_COUNT];
+  uint64_t pairs[UINT8_COUNT][UINT8_COUNT];
+
+  // Functions which executed at least one instruction.
+  ObjectFunction** functions;
+  size_t function_count;
+  size_t function_capacity;
+} OpcodeCounts;
+
+typedef struct VM {
   CallFrame frames[FRAMES_MAX];
   int frame_count;
 
@@ -29,11 +58,36 @@ typedef struct {
 
   Table globals;
 
-  Object* objects;
+  Heap heap;
 
   Table strings;
 
   ObjectUpvalue* open_upvalues;
+
+  // Modules loaded through `import`, keyed by canonical path.
+  Table modules;
+
+  // Defer compiling global function bodies until they are first called.
+  bool lazy_compile;
+
+  CacheStats cache_stats;
+
+  #ifdef DEBUG_COUNT_OPCODES
+  OpcodeCounts* opcode_counts;
+  #endif
+
+  // Class of the instances gc_stats() returns, created on first use.
+  ObjectClass* gc_stats_class;
+
+  // Deterministic call profiler, NULL unless profiling calls.
+  struct CallProfiler* call_profiler;
+
+  // Name of class initializers, interned once for comparisons.
+  ObjectString* init_string;
+
+  // Buffered standard output used by `print`. Flushed on exit, before
+  // errors are reported and by the `flush()` native.
+  Output out;
 } VM;
 
 typedef enum {
@@ -46,6 +100,37 @@ void VM_init(VM* vm);
 
 InterpretResult VM_interpret(VM* vm, const char* source);
 
+/**
+ * Runs the top-level code of a compiled script. A script can be run any
+ * number of times without compiling it again.
+ */
+InterpretResult VM_run_function(VM* vm, ObjectFunction* function);
+
+/**
+ * Registers the script at `path` as a module being loaded, so an import
+ * of it from a module it imports is reported as a cyclic import instead
+ * of running its top-level code a second time.
+ */
+void VM_enter_main(VM* vm, const char* path);
+
+/**
+ * Calls `callee` with `arg_count` arguments and stores what it returns in
+ * `result`. It may be called by a native while the VM runs: a runtime
+ * error only unwinds the frames of the call itself.
+ */
+InterpretResult VM_call(VM* vm, Value callee, int arg_count, const Value* args, Value* result);
+
+/**
+ * Empties the stack and drops every frame, for the host to start a call
+ * from a known state.
+ */
+void VM_reset_stack(VM* vm);
+
+/**
+ * Defines a global native function.
+ */
+ObjectNativeFn* VM_define_native(VM* vm, const char* name, NativeFn fn);
+
 /**
  * Retrives an interned string from the VM. If one does not already exists, it will
  * be created. `dest` will be updated to point to that object regardless.
@@ -54,6 +139,33 @@ InterpretResult VM_interpret(VM* vm, const char* source);
  */
 bool VM_get_intern_str(VM* vm, const char* chars, size_t length, ObjectString** dest);
 
+/**
+ * Returns the interned string holding the bytes of a string, slice or
+ * mapping, copying them into a flat string if none exists yet. Used where a
+ * slice has to serve as a table key or a C string.
+ *
+ * `value` must be string-like (see `Value_chars`).
+ */
+ObjectString* VM_materialize(VM* vm, Value value);
+
+/**
+ * Writes the inline cache hit rates to stderr.
+ */
+void VM_print_stats(VM* vm);
+
+/**
+ * Fills `stats` with the heap usage and collector activity so far.
+ */
+void VM_heap_stats(VM* vm, HeapStats* stats);
+
+#ifdef DEBUG_COUNT_OPCODES
+/**
+ * Writes the opcode, opcode pair and per-function counts to stderr, most
+ * frequent first.
+ */
+void VM_print_opcode_counts(VM* vm);
+#endif
+
 void VM_free(VM* vm);
 
 #endif // !peach_vm_h